@@ -0,0 +1,105 @@
+#pragma once
+
+#include "MapViewCore.h"
+#include "MapView.h"
+#include "TMSLayer.h"
+
+#include <QFutureWatcher>
+#include <QPointF>
+#include <QCache>
+
+#define HEATMAP_GRID_SIZE 64 // density cells per tile edge
+#define HEATMAP_CHUNK_SIZE 4096 // min points per binning task
+#define HEATMAP_CACHE_GRIDS 512 // dense grids kept for rendering (16 KiB each)
+#define HEATMAP_MAX_TILES 65536 // sparse tiles kept over all zooms
+
+using DensityGrid = QVector<quint32>; // HEATMAP_GRID_SIZE * HEATMAP_GRID_SIZE counts, row major
+using CellCounts = QHash<quint64,quint32>; // sparse counts keyed by heatmapCellKey(gx,gy)
+
+inline quint64 heatmapTileKey(int x, int y, int z){
+    return ((quint64)z << 48) | ((quint64)x << 24) | (quint64)y;
+}
+
+inline quint64 heatmapCellKey(quint32 gx, quint32 gy){ // global cell coordinates at maxZoom
+    return ((quint64)gx << 32) | gy;
+}
+
+inline int heatmapTileX(quint64 key){ return (key >> 24) & 0xffffff; }
+inline int heatmapTileY(quint64 key){ return key & 0xffffff; }
+inline int heatmapTileZ(quint64 key){ return key >> 48; }
+
+class HeatmapTile : public Layer{
+    Q_OBJECT
+
+    public:
+        HeatmapTile(int px, int py, int zValue, QObject *parent=nullptr);
+        ~HeatmapTile();
+
+        // cells is the part of the grid covering this tile, the whole grid unless it is scaled up
+        void render(const DensityGrid &grid, quint32 maxCount, QRect cells=QRect(0,0,HEATMAP_GRID_SIZE,HEATMAP_GRID_SIZE));
+};
+
+// Bins lon/lat points into a sparse density pyramid, zoom 0 to maxZoom. Each batch passed to
+// addPoints is binned in parallel at maxZoom and its counts are added to every zoom on the
+// GUI thread, so an update costs the size of the batch and raw points are not kept. Only
+// tiles whose counts changed are re-rendered, higher zooms show the maxZoom grid scaled up.
+// Colors are normalized to the densest visible cell.
+//
+// Once maxTiles sparse tiles exist the least recently updated deep tiles are dropped. Their
+// counts stay in the parent tile, which from then on is shown scaled up in their place and
+// takes all further counts of that area, so only resolution is lost, never history.
+// detailEvicted reports it.
+class HeatmapLayer : public LayerGroup{
+    Q_OBJECT
+
+    public:
+        HeatmapLayer(int maxZoom=12, MapGraphicsView *parent=nullptr);
+        ~HeatmapLayer();
+
+        MapGraphicsView *parentView();
+
+        DensityGrid getGrid(int x, int y, int z); // z <= maxZoom, empty if the tile has no counts
+
+        int maxZoom;
+        int maxTiles = HEATMAP_MAX_TILES;
+
+    signals:
+        void detailEvicted(int tiles); // tiles folded into their parents to stay under maxTiles
+
+    public slots:
+        void addPoints(const QVector<QPointF> &lonlats); // x - lon, y - lat
+        void clear();
+
+        void onViewLonLatChanged(double lon, double lat) override;
+        void onViewZoomChanged(double zoom) override;
+        void onViewSizeChanged(int width, int height) override;
+
+    private slots:
+        void renderTiles();
+        void clearTiles();
+        void onBinningFinished();
+
+    private:
+        struct DensityTile{
+            QHash<quint16,quint32> cells; // cy * HEATMAP_GRID_SIZE + cx -> count
+            quint64 updated = 0;
+            bool coarse = false; // children were evicted, deeper zooms show this tile
+        };
+
+        void startBinning();
+        void evictTiles();
+        bool sourceTile(int x, int y, int zoom, quint64 &key); // pyramid tile shown for a view tile
+
+        QHash<quint64,DensityTile> tiles; // every zoom, an ancestor exists for every tile
+        QCache<quint64,DensityGrid> gridCache;
+        quint64 updateCounter = 0;
+
+        QVector<QPointF> pending;
+        QFutureWatcher<CellCounts> binning;
+        int generation = 0;
+        int binningGeneration = 0;
+
+        QSet<quint64> dirtyTiles; // tiles of the shown zoom
+        quint32 renderedMax = 0;
+        QHash<QPair<int,int>,HeatmapTile*> tileStack;
+};
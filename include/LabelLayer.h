@@ -0,0 +1,102 @@
+#pragma once
+
+#include "MapViewCore.h"
+#include "MapView.h"
+
+#include <QFont>
+
+#define LABEL_GRID_CELL 64 // px, collision grid cell size
+#define LABEL_OFFSET 6 // px between anchor and text
+#define LABEL_BUDGET_CHECK 1024 // labels placed between frame budget checks
+
+struct MapLabel{
+    QString text;
+    QPointF world; // scene point at zoom 0
+    QSizeF size; // text size, px
+    int priority; // higher is placed first
+};
+
+struct PlacedLabel{
+    QString text;
+    QRectF rect; // scene coordinates of the current zoom
+};
+
+// Screen space collision index, a rect is only accepted when it overlaps nothing placed before
+class LabelGridIndex{
+    public:
+        LabelGridIndex(QRectF region, qreal cellSize=LABEL_GRID_CELL);
+
+        bool insertIfFree(const QRectF &rect);
+
+    private:
+        QRectF region;
+        qreal cellSize;
+        int cols, rows;
+        QVector<QVector<QRectF>> cells;
+};
+
+// Draws every placed label in a single paint call
+class LabelItem : public QGraphicsItem{
+    public:
+        LabelItem(QGraphicsItem *parent=nullptr);
+
+        QRectF boundingRect() const override;
+        void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget=nullptr) override;
+
+        void setPlaced(const QVector<PlacedLabel> &placed, QRectF region);
+        void setFont(QFont font);
+
+    private:
+        QVector<PlacedLabel> placed;
+        QRectF region;
+        QFont font;
+};
+
+// Greedy, priority ordered label placement for the current camera. Labels are placed for the
+// viewport plus a margin, so while the camera only translates inside it the result is reused.
+// Placement that doesn't fit in frameBudget is shown as far as it got and continued over the
+// following event loop passes.
+class LabelLayer : public Layer{
+    Q_OBJECT
+
+    public:
+        LabelLayer(QObject *parent=nullptr);
+        ~LabelLayer();
+
+        MapGraphicsView *parentView();
+
+        void addLabel(QString text, double lon, double lat, int priority=0);
+        void clear();
+
+        void setFont(QFont font);
+        QFont getFont();
+        int getPlacedCount();
+
+        int frameBudget = 8; // ms per pass, lower priority labels wait for the next one
+
+    public slots:
+        void onViewLonLatChanged(double lon, double lat) override;
+        void onViewZoomChanged(double zoom) override;
+        void onViewSizeChanged(int width, int height) override;
+
+    private slots:
+        void placeLabels();
+
+    private:
+        void invalidate();
+
+        LabelItem *labelItem();
+
+        QVector<MapLabel> labels;
+        QFont font;
+        bool dirty = false;
+        bool placementScheduled = false;
+        QRectF placedRegion;
+        double placedZoom = -1;
+        int placedCount = 0;
+
+        // placement in progress for placedRegion and placedZoom
+        LabelGridIndex placingIndex = LabelGridIndex(QRectF());
+        QVector<PlacedLabel> placing;
+        qsizetype resumeIndex = -1; // next label to try, -1 when complete
+};
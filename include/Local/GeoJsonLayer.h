@@ -0,0 +1,154 @@
+#pragma once
+
+#include "MapViewCore.h"
+#include "MapView.h"
+
+#include <QThread>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <QPolygonF>
+#include <QJsonObject>
+#include <QJsonArray>
+
+#define GEOJSON_READ_BLOCK (1 << 16) // bytes per file read
+#define GEOJSON_CHUNK_FEATURES 2000 // features per chunk
+#define GEOJSON_FLUSH_INTERVAL 50 // ms, partially filled chunks are handed over after that
+#define GEOJSON_MAX_PENDING_CHUNKS 8 // chunks in flight between reader and GUI thread
+#define GEOJSON_MAX_FEATURE_BYTES (64 << 20) // larger single features are skipped
+#define GEOJSON_DETAIL_ZOOM 18 // vertices closer than a pixel at this zoom are dropped on load
+#define GEOJSON_MIN_DETAIL_ZOOM 8 // coarsest detail the vertex bound may reduce to
+#define GEOJSON_MAX_VERTICES 8000000 // resident vertices per layer
+
+// Line string or polygon ring, in scene coordinates of zoom 0
+struct FeatureLine{
+    QPolygonF polygon; // closed rings repeat the first point
+    QRectF bounds;
+};
+
+// Projected features ready to be shown
+struct FeatureChunk{
+    QVector<FeatureLine> lines;
+    QVector<QPointF> points;
+    int features = 0;
+    qint64 vertices = 0;
+};
+Q_DECLARE_METATYPE(FeatureChunk)
+
+// Incrementally reads a GeoJSON FeatureCollection or newline delimited GeoJSON file.
+// Only one feature is buffered at a time, features over GEOJSON_MAX_FEATURE_BYTES are
+// skipped with a warning instead. Coordinates are projected and decimated per chunk.
+class GeoJsonReader : public QObject{
+    Q_OBJECT
+
+    public:
+        GeoJsonReader(QString path, QSemaphore *credits, QAtomicInt *cancelled, QAtomicInt *detailZoom, QObject *parent=nullptr);
+        ~GeoJsonReader();
+
+    public slots:
+        void read();
+
+    signals:
+        void chunkReady(FeatureChunk chunk);
+        void finished(qint64 features);
+        void failed(QString error);
+
+    private:
+        struct Part{
+            int start, count;
+            bool closed, points;
+        };
+
+        void scan(QByteArray &buffer);
+        void parseFeature(const QByteArray &json);
+        void appendGeometry(const QJsonObject &geometry);
+        void appendCoordinates(const QJsonArray &coordinates, bool closed, bool points);
+        void flush();
+
+        QString path;
+        QSemaphore *credits;
+        QAtomicInt *cancelled;
+        QAtomicInt *detailZoom;
+
+        // scanner state
+        qsizetype scanPos = 0;
+        int depth = 0;
+        bool inString = false;
+        bool escape = false;
+        qsizetype stringStart = -1;
+        qsizetype captureStart = -1;
+        int captureDepth = -1;
+        bool skipping = false; // inside an oversized feature
+        int featuresDepth = -1;
+        QByteArray lastString;
+
+        // current chunk
+        QVector<QPointF> lonlats;
+        QVector<Part> parts;
+        int features = 0;
+        qint64 total = 0;
+        QElapsedTimer flushClock;
+};
+
+class FeatureChunkItem : public QGraphicsItem{
+    public:
+        FeatureChunkItem(const FeatureChunk &chunk, QColor color, QGraphicsItem *parent=nullptr);
+
+        QRectF boundingRect() const override;
+        void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget=nullptr) override;
+
+        void setPixelSize(qreal size); // scene units per screen pixel, for point and pen margins
+        qint64 decimate(double tolerance); // drops vertices closer than tolerance, returns those left
+
+    private:
+        QVector<FeatureLine> lines;
+        QVector<QPointF> points;
+        QRectF bounds;
+        QColor color;
+        qreal pixelSize = 1;
+};
+
+// Streams features from a file into the map. Chunks become visible as they arrive and are
+// scaled with the view zoom instead of being reprojected. Lines are decimated to the
+// current zoom while painting.
+//
+// Memory is bounded by maxVertices: vertices finer than a pixel at detailZoom are dropped
+// on load, and whenever the bound is hit detailZoom is lowered and everything loaded so
+// far decimated again, so the whole file stays visible at less detail. Only when even
+// GEOJSON_MIN_DETAIL_ZOOM doesn't fit, loading stops and loadFinished reports truncation.
+class GeoJsonLayer : public Layer{
+    Q_OBJECT
+
+    public:
+        GeoJsonLayer(QString path, QColor color=QColor(200,0,100), QObject *parent=nullptr);
+        ~GeoJsonLayer();
+
+        void load();
+        void cancel();
+        qint64 getFeatureCount();
+
+        qint64 maxVertices = GEOJSON_MAX_VERTICES;
+        int detailZoom = GEOJSON_DETAIL_ZOOM; // initial, lowered while loading if needed
+        int getDetailZoom();
+
+    signals:
+        void loadFinished(qint64 features, bool truncated); // features kept
+
+    public slots:
+        void onViewZoomChanged(double zoom) override;
+
+    private slots:
+        void onChunkReady(FeatureChunk chunk);
+        void onReaderFinished();
+
+    private:
+        QString path;
+        QColor color;
+        QThread *thread = nullptr;
+        QSemaphore credits;
+        QAtomicInt cancelled;
+        QAtomicInt currentDetailZoom;
+        bool truncated = false;
+        qint64 featureCount = 0;
+        qint64 vertexCount = 0;
+        QVector<FeatureChunkItem*> chunks;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "TMSLayer.h"
+
+#include <QFile>
+#include <QImage>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QThreadPool>
+#include <QSharedPointer>
+
+struct RasterInfo{
+    int width, height;
+    int channels; // interleaved 8 bit samples, 3 (RGB) or 4 (RGBA)
+    double xmin, ymin, xmax, ymax; // EPSG:3857 extent, meters
+    qint64 offset = 0; // bytes before the first pixel (header)
+};
+
+// Memory mapped raster in EPSG:3857. Tiles are cut on demand from the source or from
+// 2x box filtered overview levels, which are generated once into cacheDir and mapped
+// from there on. Each level is built at most once, under its own lock and on a pool of
+// its own, so renders of other levels keep going meanwhile. renderTile is thread safe.
+class RasterSource{
+    public:
+        RasterSource(QString path, RasterInfo info, QString cacheDir=QString());
+        ~RasterSource();
+
+        bool isValid();
+        RasterInfo getInfo();
+        int levelCount();
+
+        QImage renderTile(int x, int y, int z, int tileSize=TILE_SIZE);
+
+    private:
+        struct Level{
+            const uchar *data = nullptr;
+            int width = 0, height = 0;
+            QFile *file = nullptr; // owns the mapping
+            bool built = false; // also set when building failed, so it isn't retried
+        };
+
+        const Level &level(int i);
+        bool buildOverview(int i);
+        bool writeOverview(const Level &src, const Level &dst, QString name);
+        QString overviewPath(int i);
+
+        QString path;
+        QString cacheDir;
+        RasterInfo info;
+        QVector<Level> levels; // sized once in the constructor
+        QVector<QMutex*> locks; // one per level
+        QThreadPool pool; // overview filtering, callers already run on the global pool
+};
+
+class RasterTile : public Tile{
+    Q_OBJECT
+
+    public:
+        RasterTile(QSharedPointer<RasterSource> source, const TileInfo &info, int zValue, QObject *parent=nullptr);
+        ~RasterTile();
+
+    private slots:
+        void onRendered();
+
+    private:
+        QFutureWatcher<QImage> rendering;
+};
+
+class LocalRasterLayer : public TileLayer{
+    Q_OBJECT
+
+    public:
+        LocalRasterLayer(QString path, RasterInfo info, MapGraphicsView *parent=nullptr);
+        ~LocalRasterLayer();
+
+        QSharedPointer<RasterSource> getSource();
+
+    protected:
+        Tile *createTile(const TileInfo &info) override;
+
+    private:
+        QSharedPointer<RasterSource> source;
+};
@@ -2,6 +2,9 @@
 
 #include <QGraphicsView>
 #include <QWidget>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QGraphicsPixmapItem>
 
 #include "MapViewCore.h"
 
@@ -11,6 +14,8 @@
     #define MAPVIEW_DEBUG
 #endif
 
+#define MAX_MERCATOR_LAT 85.0511287798 // web mercator latitude limit
+
 using Camera = LonLatZoom;
 
 Point mercatorProject(LonLat pos);
@@ -37,12 +42,24 @@ class MapGraphicsView: public QGraphicsView{
 
         void addLayer(ILayer *layer);
 
+        // Persistence is off until a key is set. With a key the camera and a viewport snapshot
+        // are saved on quit under that key, so several views don't overwrite each other.
+        void setStateKey(QString key);
+        QString getStateKey();
+        // last camera and viewport snapshot, shown until live tiles cover it
+        bool restoreState();
+
+        double minZoom = 0;
+        double maxZoom = 20;
+
     protected:
 
         void resizeEvent(QResizeEvent *event) override;
         void mouseMoveEvent(QMouseEvent *event) override;
         void mousePressEvent(QMouseEvent *event) override;
+        void mouseReleaseEvent(QMouseEvent *event) override;
         void wheelEvent(QWheelEvent *event) override;
+        void paintEvent(QPaintEvent *event) override;
 
         #ifdef MAPVIEW_DEBUG
             QGraphicsLineItem *camHLine;
@@ -53,16 +70,35 @@ class MapGraphicsView: public QGraphicsView{
         void lonLatChanged(double lon, double zoom);
         void zoomChanged(double zoom);
         void sizeChanged(int widht, int height);
+        void firstFramePainted(); // once, after the first paint of the viewport
 
     private:
         Camera cam = Camera(-3,40,7);
-        QPointF previousP;
+        QPoint previousP;
         QVector<ILayer*> layers;
 
+        // kinetic panning
+        QTimer kineticTimer;
+        QElapsedTimer dragClock;
+        QPointF velocity; // viewport px per ms
+        QPointF kineticRemainder;
+
+        QGraphicsPixmapItem *snapshot = nullptr;
+        QString stateKey;
+        QMetaObject::Connection saveOnQuit;
+        bool framePainted = false;
+
+        QString snapshotPath();
+        void panBy(QPoint delta);
+        void updateSceneRect();
+        void clearSnapshot();
+
     private slots:
         void onLonLatChanged();
         void onZoomChanged();
+        void onKineticTick();
 
     public slots:
         void addItem(QGraphicsItem *item);
+        void saveState();
 };
\ No newline at end of file
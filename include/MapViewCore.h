@@ -33,6 +33,7 @@ class LonLat : private Point{
         double &lat = Point::y;
 
         LonLat(double lon, double lat);
+        LonLat(const LonLat & other); // lon/lat must keep referring to this object
         LonLat &operator=(const LonLat & other);
 };
 
@@ -75,6 +76,7 @@ class Layer: public ILayer{
 
         QGraphicsItem *getItem();
         void setPos(int px, int py, int zValue);
+        void setZValue(int zValue) override;
         Point3D getPos();
 
     protected:
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "MapViewCore.h"
+#include "MapView.h"
+
+#include <QMutex>
+#include <QTimer>
+#include <QColor>
+#include <QtNumeric>
+
+#define MOVING_INDEX_GRID 256 // spatial index cells per world edge
+#define MOVING_DIRTY_BUCKET 128 // px, repaint granularity
+#define MOVING_SYMBOL_SIZE 12 // px
+#define MOVING_FRAME_INTERVAL 16 // ms
+
+// Only the fields flagged as present are applied, so position and heading may arrive separately
+struct ObjectUpdate{
+    quint32 id = 0;
+    double lon = 0, lat = 0;
+    float heading = qQNaN(); // degrees clockwise from north, NaN if unknown
+    bool hasPosition = false;
+    bool hasHeading = false;
+    bool remove = false;
+};
+
+struct MovingObject{
+    QPointF world; // scene point at zoom 0
+    float heading;
+    int cell;
+};
+
+class MovingObjectLayer;
+
+class MovingObjectItem : public QGraphicsItem{
+    public:
+        MovingObjectItem(MovingObjectLayer *layer, QGraphicsItem *parent=nullptr);
+
+        QRectF boundingRect() const override;
+        void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget=nullptr) override;
+
+        void setZoom(double zoom);
+
+    private:
+        MovingObjectLayer *layer;
+        double scale = 1;
+};
+
+// Many moving objects drawn by one item. Updates are pushed from any thread into a
+// buffer that the GUI thread swaps out once per frame, unapplied updates of an object
+// are merged field by field. Only the screen areas around changed objects are repainted.
+class MovingObjectLayer : public Layer{
+    Q_OBJECT
+
+    public:
+        MovingObjectLayer(QObject *parent=nullptr);
+        ~MovingObjectLayer();
+
+        MapGraphicsView *parentView();
+
+        void pushUpdates(const QVector<ObjectUpdate> &updates); // thread safe
+
+        int getObjectCount();
+        QVector<quint32> objectsIn(const QRectF &worldRect); // zoom 0 scene coordinates
+
+        QColor color = QColor(20,60,160);
+
+    public slots:
+        void onViewZoomChanged(double zoom) override;
+
+    private slots:
+        void applyUpdates();
+
+    private:
+        friend class MovingObjectItem;
+
+        int cellOf(QPointF world);
+        void markDirty(QPointF world);
+        void paintObjects(QPainter *painter, const QRectF &exposed);
+
+        QMutex pendingMutex;
+        QHash<quint32,ObjectUpdate> pending;
+
+        QHash<quint32,MovingObject> objects;
+        QHash<int,QVector<quint32>> index; // cell -> object ids
+        QSet<QPair<int,int>> dirtyBuckets;
+        QRectF visible;
+        double scale = 1;
+
+        QTimer frameTimer;
+};
@@ -2,8 +2,7 @@
 
 #include "MapViewCore.h"
 #include "MapView.h"
-#include <QNetworkAccessManager>
-#include <QNetworkReply>
+#include "TileFetcher.h"
 
 #define TILE_SIZE 256
 #define WEBMERCATOR_R 6378137.0
@@ -13,15 +12,19 @@ class Tile : public Layer{
     Q_OBJECT
 
     public:
-        Tile(QString url, int px, int py, int zValue, QObject *parent=nullptr);
+        Tile(int px, int py, int zValue, QObject *parent=nullptr);
+        Tile(QString url, TileFetcher *fetcher, int px, int py, int zValue, QObject *parent=nullptr);
         ~Tile();
 
+        void setPixmap(QPixmap pixmap);
+
     private:
-        QNetworkReply *reply = nullptr;
+        TileRequest *request = nullptr;
         QString url;
 
     private slots:
-        void processResponse();
+        void processResponse(QByteArray data);
+        void processFailure(QString error);
 };
 
 struct TileInfo{
@@ -39,15 +42,20 @@ struct BBox{
 using TileGrid = QVector<TileInfo>;
 using TileMap = QVector<Tile*>;
 
+TileGrid getVisibleTiles(MapGraphicsView *view);
+
 class TileLayer: public LayerGroup{
     Q_OBJECT
 
     public:
-        TileLayer(QString baseUrl, MapGraphicsView *parent=nullptr);
+        TileLayer(QString baseUrl, QStringList subdomains={}, MapGraphicsView *parent=nullptr);
         ~TileLayer();
 
         MapGraphicsView *parentView();
 
+        void setFetcher(TileFetcher *fetcher);
+        TileFetcher *getFetcher();
+
         bool validateTileUrl(int x, int y, int z);
         QString getTileUrl(int x, int y, int z);
         QVector<TileInfo> getVisibleTiles();
@@ -59,11 +67,15 @@ class TileLayer: public LayerGroup{
         void onViewZoomChanged(double zoom) override;
         void onViewSizeChanged(int width, int height) override;
 
+    protected:
+        virtual Tile *createTile(const TileInfo &info);
+
     private slots:
         void renderTiles();
         void clearTiles();
        
     private:
         QString baseUrl;
+        TileFetcher *fetcher;
         QHash<QPair<int,int>,Tile*> tileStack;
 };
\ No newline at end of file
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <QObject>
+#include <QPointer>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+
+#define HOST_STATS_WINDOW 64 // latency samples kept per mirror
+
+struct HostStats{
+    QVector<qint64> latencies; // ring buffer of successful reply latencies, ms
+    int next = 0;
+    int inFlight = 0;
+    int failures = 0; // consecutive
+    int aborted = 0; // attempts a faster mirror won since this host last won one
+
+    void addLatency(qint64 ms);
+    qint64 percentile(double p) const; // -1 without samples
+};
+
+class TileFetcher;
+
+// Single logical tile download. Starts on the best mirror, fires a hedged duplicate to
+// another mirror once the first one is slower than its latency percentile, and retries
+// with exponential backoff when every attempt failed. The first successful reply wins.
+class TileRequest : public QObject{
+    Q_OBJECT
+
+    public:
+        TileRequest(QString urlTemplate, TileFetcher *fetcher, QObject *parent=nullptr);
+        ~TileRequest();
+
+    signals:
+        void finished(QByteArray data);
+        void failed(QString error);
+
+    private slots:
+        void onReplyFinished();
+        void hedge();
+        void retry();
+
+    private:
+        struct Attempt{
+            QString subdomain;
+            qint64 startedAt;
+        };
+
+        void startAttempt();
+        void abortAttempts(bool lost);
+
+        QString urlTemplate;
+        QPointer<TileFetcher> fetcher;
+        QHash<QNetworkReply*,Attempt> attempts;
+        QElapsedTimer clock;
+        QTimer hedgeTimer;
+        QTimer retryTimer;
+        int hedges = 0;
+        int retries = 0;
+        bool done = false;
+};
+
+// Spreads tile requests over {s} mirror subdomains and tracks per-host latency.
+// Subdomains may also be "host:port" pairs, e.g. local stand-in servers for testing
+// with the template "http://{s}/tile/{z}/{x}/{y}.png".
+class TileFetcher : public QObject{
+    Q_OBJECT
+
+    public:
+        TileFetcher(QNetworkAccessManager *manager=nullptr, QObject *parent=nullptr);
+        ~TileFetcher();
+
+        TileRequest *fetch(QString urlTemplate, QObject *parent=nullptr);
+
+        void setSubdomains(QStringList subdomains);
+        QStringList getSubdomains();
+        HostStats getStats(QString subdomain);
+
+        QString pickSubdomain(const QStringList &exclude={});
+        bool hasAlternative(const QStringList &exclude); // a mirror outside exclude exists
+        QString resolveUrl(QString urlTemplate, QString subdomain);
+        int hedgeDelay(QString subdomain);
+
+        QNetworkAccessManager *manager();
+
+        double hedgePercentile = 0.9;
+        int minHedgeSamples = 8; // defaultHedgeDelay is used until a host has that many samples
+        int defaultHedgeDelay = 500; // ms
+        int minHedgeDelay = 50; // ms
+        int maxHedges = 1; // duplicates per request
+        int maxRetries = 3;
+        int retryBackoff = 250; // ms, doubled on every retry
+
+    private:
+        friend class TileRequest;
+
+        void attemptStarted(QString subdomain);
+        void attemptFinished(QString subdomain, qint64 latency, bool ok);
+        void attemptCancelled(QString subdomain, qint64 elapsed, bool lost);
+
+        QNetworkAccessManager *mgr;
+        QStringList subdomains;
+        QHash<QString,HostStats> stats;
+        int roundRobin = 0;
+};
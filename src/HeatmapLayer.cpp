@@ -0,0 +1,331 @@
+#include "HeatmapLayer.h"
+
+#include <QtConcurrent>
+#include <QThread>
+#include <QGraphicsPixmapItem>
+#include <algorithm>
+
+// ======================
+
+static QRgb heatColor(double t){ // t in [0,1]
+    static const QColor stops[] = {
+        QColor(0,0,255,80),
+        QColor(0,255,255,140),
+        QColor(255,255,0,190),
+        QColor(255,0,0,230)
+    };
+    const int last = sizeof(stops)/sizeof(stops[0]) - 1;
+    const double pos = qBound(0.0,t,1.0) * last;
+    const int i = qMin((int)pos,last-1);
+    const double f = pos - i;
+    const QColor &a = stops[i], &b = stops[i+1];
+    return qPremultiply(qRgba(
+        a.red() + (b.red()-a.red())*f,
+        a.green() + (b.green()-a.green())*f,
+        a.blue() + (b.blue()-a.blue())*f,
+        a.alpha() + (b.alpha()-a.alpha())*f
+    ));
+}
+
+static CellCounts binPoints(const QVector<QPointF> &lonlats, int maxZoom){
+    CellCounts result;
+    const double n = pow(2,maxZoom);
+    const double cells = n * HEATMAP_GRID_SIZE;
+    for(const QPointF &p: lonlats){
+        if(!(qAbs(p.y()) < MAX_MERCATOR_LAT)) continue;
+        Point3D t = lonlat2tile(LonLatZoom(p.x(),p.y(),maxZoom));
+        if(!(t.x >= 0 && t.x < n && t.y >= 0 && t.y < n)) continue;
+
+        const quint32 gx = qMin(t.x * HEATMAP_GRID_SIZE,cells-1);
+        const quint32 gy = qMin(t.y * HEATMAP_GRID_SIZE,cells-1);
+        result[heatmapCellKey(gx,gy)]++;
+    }
+    return result;
+}
+
+static void mergeCounts(CellCounts &result, const CellCounts &partial){
+    for(auto it = partial.cbegin(); it != partial.cend(); ++it){
+        result[it.key()] += it.value();
+    }
+}
+
+// ======================
+
+HeatmapTile::HeatmapTile(int px, int py, int zValue, QObject *parent) : Layer(px,py,zValue,parent){
+
+}
+
+void HeatmapTile::render(const DensityGrid &grid, quint32 maxCount, QRect cells){
+    QImage image(cells.width(),cells.height(),QImage::Format_ARGB32_Premultiplied);
+    const double logMax = log1p(qMax(maxCount,1u));
+    for(int y = 0; y < cells.height(); y++){
+        QRgb *line = reinterpret_cast<QRgb*>(image.scanLine(y));
+        const quint32 *counts = grid.constData() + (cells.y()+y)*HEATMAP_GRID_SIZE + cells.x();
+        for(int x = 0; x < cells.width(); x++){
+            line[x] = counts[x] ? heatColor(log1p(counts[x]) / logMax) : 0;
+        }
+    }
+    QPixmap pixmap = QPixmap::fromImage(image);
+
+    if(this->item){
+        static_cast<QGraphicsPixmapItem*>(this->item)->setPixmap(pixmap);
+        return;
+    }
+
+    QGraphicsPixmapItem *pixmapItem = new QGraphicsPixmapItem(pixmap);
+    pixmapItem->setTransformationMode(Qt::SmoothTransformation);
+    pixmapItem->setScale(TILE_SIZE / (double)cells.width());
+    this->item = pixmapItem;
+    this->item->setPos(this->px,this->py);
+    this->item->setZValue(this->zValue);
+
+    emit this->itemCreated(this->item);
+}
+
+HeatmapTile::~HeatmapTile(){
+
+}
+
+// ======================
+
+HeatmapLayer::HeatmapLayer(int maxZoom, MapGraphicsView *parent) : LayerGroup(0,parent), maxZoom(maxZoom){
+    gridCache.setMaxCost(HEATMAP_CACHE_GRIDS);
+    connect(&binning,&QFutureWatcher<CellCounts>::finished,this,&HeatmapLayer::onBinningFinished);
+}
+
+MapGraphicsView *HeatmapLayer::parentView(){
+    return static_cast<MapGraphicsView*>(parent());
+}
+
+DensityGrid HeatmapLayer::getGrid(int x, int y, int z){
+    const quint64 key = heatmapTileKey(x,y,z);
+    if(DensityGrid *cached = gridCache.object(key)) return *cached;
+
+    DensityGrid grid;
+    auto tile = tiles.constFind(key);
+    if(tile != tiles.constEnd()){
+        grid.fill(0,HEATMAP_GRID_SIZE*HEATMAP_GRID_SIZE);
+        for(auto cell = tile->cells.cbegin(); cell != tile->cells.cend(); ++cell){
+            grid[cell.key()] = cell.value();
+        }
+    }
+
+    gridCache.insert(key,new DensityGrid(grid));
+    return grid;
+}
+
+bool HeatmapLayer::sourceTile(int x, int y, int zoom, quint64 &key){
+    // walk down from zoom 0, stopping at a tile whose children were evicted
+    const int deepest = qMin(zoom,maxZoom);
+    for(int z = 0; z <= deepest; z++){
+        const quint64 k = heatmapTileKey(x >> (zoom-z),y >> (zoom-z),z);
+        auto tile = tiles.constFind(k);
+        if(tile == tiles.constEnd()) return false; // no counts here at all
+        key = k;
+        if(tile->coarse) break;
+    }
+    return true;
+}
+
+void HeatmapLayer::addPoints(const QVector<QPointF> &lonlats){
+    pending += lonlats;
+    if(!binning.isRunning()) startBinning();
+}
+
+void HeatmapLayer::clear(){
+    generation++;
+    pending.clear();
+    tiles.clear();
+    gridCache.clear();
+    renderedMax = 0;
+    clearTiles();
+}
+
+void HeatmapLayer::startBinning(){
+    if(pending.isEmpty()) return;
+
+    // one task per core, each bins its own chunk into sparse counts which are then summed
+    const int chunkSize = qMax<qsizetype>(HEATMAP_CHUNK_SIZE,pending.size() / QThread::idealThreadCount() + 1);
+    QVector<QVector<QPointF>> chunks;
+    for(qsizetype i = 0; i < pending.size(); i += chunkSize){
+        chunks.push_back(pending.mid(i,chunkSize));
+    }
+    pending.clear();
+
+    const int zoom = maxZoom;
+    binningGeneration = generation;
+    binning.setFuture(QtConcurrent::mappedReduced(
+        std::move(chunks),
+        [zoom](const QVector<QPointF> &chunk){ return binPoints(chunk,zoom); },
+        mergeCounts
+    ));
+}
+
+void HeatmapLayer::onBinningFinished(){
+    if(binningGeneration == generation){
+        const CellCounts counts = binning.result();
+        const int zoom = parent() ? (int)parentView()->getCamera().zoom : -1;
+        const int shown = qMin(zoom,maxZoom);
+        updateCounter++;
+
+        // add the batch to every zoom, costs the batch size and not the data set
+        for(auto it = counts.cbegin(); it != counts.cend(); ++it){
+            const quint32 gx = it.key() >> 32, gy = it.key() & 0xffffffff;
+            quint64 source = 0;
+            for(int z = 0; z <= maxZoom; z++){
+                const quint32 cx = gx >> (maxZoom-z), cy = gy >> (maxZoom-z);
+                const quint64 key = heatmapTileKey(cx / HEATMAP_GRID_SIZE,cy / HEATMAP_GRID_SIZE,z);
+
+                DensityTile &tile = tiles[key];
+                tile.cells[(cy % HEATMAP_GRID_SIZE) * HEATMAP_GRID_SIZE + cx % HEATMAP_GRID_SIZE] += it.value();
+                if(tile.updated != updateCounter){
+                    tile.updated = updateCounter;
+                    gridCache.remove(key);
+                }
+                if(z <= shown) source = key;
+                if(tile.coarse) break; // deeper zooms show this tile
+            }
+            if(zoom >= 0) dirtyTiles.insert(source);
+        }
+
+        evictTiles();
+        if(parent()) renderTiles();
+    }
+
+    startBinning();
+}
+
+void HeatmapLayer::evictTiles(){
+    if(tiles.size() <= maxTiles) return;
+
+    // least recently updated first, deeper first among equals. A tile is updated whenever
+    // one of its children is, so children always go before their parent.
+    struct Candidate{
+        quint64 updated;
+        int z;
+        quint64 key;
+    };
+    QVector<Candidate> candidates;
+    candidates.reserve(tiles.size());
+    for(auto it = tiles.cbegin(); it != tiles.cend(); ++it){
+        const int z = heatmapTileZ(it.key());
+        if(z > 0) candidates.push_back({it->updated,z,it.key()});
+    }
+    std::sort(candidates.begin(),candidates.end(),[](const Candidate &a, const Candidate &b){
+        return a.updated != b.updated ? a.updated < b.updated : a.z > b.z;
+    });
+
+    // drop a tenth at once so this stays rare, the parent already holds the counts
+    const qsizetype drop = tiles.size() - maxTiles * 9 / 10;
+    int evicted = 0;
+    for(const Candidate &candidate: candidates){
+        if(evicted >= drop) break;
+        const int x = heatmapTileX(candidate.key), y = heatmapTileY(candidate.key);
+        tiles[heatmapTileKey(x >> 1,y >> 1,candidate.z-1)].coarse = true;
+        tiles.remove(candidate.key);
+        gridCache.remove(candidate.key);
+        evicted++;
+    }
+
+    clearTiles(); // shown tiles may now come from a parent
+    emit detailEvicted(evicted);
+}
+
+void HeatmapLayer::onViewLonLatChanged(double lon, double lat){
+    renderTiles();
+}
+
+void HeatmapLayer::onViewZoomChanged(double zoom){
+    dirtyTiles.clear(); // keyed by the previous zoom
+    clearTiles();
+    renderTiles();
+}
+
+void HeatmapLayer::onViewSizeChanged(int width, int height){
+    renderTiles();
+}
+
+void HeatmapLayer::renderTiles(){
+    MapGraphicsView *view = parentView();
+    const int zoom = view->getCamera().zoom;
+    TileGrid newGrid = getVisibleTiles(view);
+
+    struct VisibleGrid{
+        TileInfo info;
+        quint64 key;
+        DensityGrid grid;
+        QRect cells;
+    };
+    QVector<VisibleGrid> visible;
+    quint32 maxCount = 0;
+    const int n = 1 << zoom;
+
+    for(auto info: newGrid){
+        if(info.x < 0 || info.y < 0 || info.x >= n || info.y >= n) continue;
+
+        VisibleGrid entry{info,0,{},QRect(0,0,HEATMAP_GRID_SIZE,HEATMAP_GRID_SIZE)};
+        if(!sourceTile(info.x,info.y,zoom,entry.key)) continue;
+
+        // above maxZoom or under evicted detail only part of the source grid is shown, scaled up
+        const int d = zoom - heatmapTileZ(entry.key);
+        const int sx = heatmapTileX(entry.key), sy = heatmapTileY(entry.key);
+        entry.grid = getGrid(sx,sy,zoom - d);
+        if(d > 0){
+            const int size = qMax(1,HEATMAP_GRID_SIZE >> d);
+            entry.cells = QRect(
+                ((info.x - (sx << d)) * HEATMAP_GRID_SIZE) >> d,
+                ((info.y - (sy << d)) * HEATMAP_GRID_SIZE) >> d,
+                size,size
+            );
+        }
+        if(entry.grid.isEmpty()) continue;
+
+        for(int y = entry.cells.top(); y <= entry.cells.bottom(); y++){
+            const quint32 *counts = entry.grid.constData() + y*HEATMAP_GRID_SIZE;
+            for(int x = entry.cells.left(); x <= entry.cells.right(); x++){
+                maxCount = qMax(maxCount,counts[x]);
+            }
+        }
+        visible << entry;
+    }
+
+    // drop tiles that scrolled out
+    QSet<QPair<int,int>> visibleCoords;
+    for(const VisibleGrid &entry: visible){
+        visibleCoords.insert({entry.info.px,entry.info.py});
+    }
+    for(auto key: tileStack.keys()){
+        if(!visibleCoords.contains(key)){
+            tileStack.take(key)->deleteLater();
+        }
+    }
+
+    const bool rescaled = maxCount != renderedMax;
+    renderedMax = maxCount;
+
+    for(const VisibleGrid &entry: visible){
+        HeatmapTile *&tile = tileStack[{entry.info.px,entry.info.py}];
+        if(!tile){
+            tile = new HeatmapTile(entry.info.px,entry.info.py,this->zValue);
+            connect(tile,&Layer::itemCreated,this,&LayerGroup::itemCreated);
+        } else if(!rescaled && !dirtyTiles.contains(entry.key)){
+            continue;
+        }
+        tile->render(entry.grid,maxCount,entry.cells);
+    }
+
+    dirtyTiles.clear();
+}
+
+void HeatmapLayer::clearTiles(){
+    for(HeatmapTile *tile: tileStack){
+        tile->deleteLater();
+    }
+    tileStack.clear();
+}
+
+HeatmapLayer::~HeatmapLayer(){
+    binning.waitForFinished();
+}
+
+// ======================
@@ -0,0 +1,190 @@
+#include "LabelLayer.h"
+
+#include <QPainter>
+#include <QFontMetricsF>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QStyleOptionGraphicsItem>
+#include <algorithm>
+
+// ======================
+
+LabelGridIndex::LabelGridIndex(QRectF region, qreal cellSize) : region(region), cellSize(cellSize){
+    cols = qMax(1,(int)ceil(region.width() / cellSize));
+    rows = qMax(1,(int)ceil(region.height() / cellSize));
+    cells.resize(cols * rows);
+}
+
+bool LabelGridIndex::insertIfFree(const QRectF &rect){
+    const int x0 = qBound(0,(int)((rect.left() - region.left()) / cellSize),cols-1);
+    const int x1 = qBound(0,(int)((rect.right() - region.left()) / cellSize),cols-1);
+    const int y0 = qBound(0,(int)((rect.top() - region.top()) / cellSize),rows-1);
+    const int y1 = qBound(0,(int)((rect.bottom() - region.top()) / cellSize),rows-1);
+
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            for(const QRectF &other: cells[y*cols+x]){
+                if(other.intersects(rect)) return false;
+            }
+        }
+    }
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            cells[y*cols+x] << rect;
+        }
+    }
+    return true;
+}
+
+// ======================
+
+LabelItem::LabelItem(QGraphicsItem *parent) : QGraphicsItem(parent){
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption); // exposedRect, panning only repaints strips
+}
+
+QRectF LabelItem::boundingRect() const{
+    return region;
+}
+
+void LabelItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget){
+    painter->setFont(font);
+    painter->setPen(Qt::black);
+    for(const PlacedLabel &label: placed){
+        if(!label.rect.intersects(option->exposedRect)) continue;
+        painter->fillRect(label.rect,QColor(255,255,255,170));
+        painter->drawText(label.rect,Qt::AlignCenter,label.text);
+    }
+}
+
+void LabelItem::setPlaced(const QVector<PlacedLabel> &placed, QRectF region){
+    prepareGeometryChange();
+    this->placed = placed;
+    this->region = region;
+    update();
+}
+
+void LabelItem::setFont(QFont font){
+    this->font = font;
+    update();
+}
+
+// ======================
+
+LabelLayer::LabelLayer(QObject *parent) : Layer(0,0,0,parent){
+    this->item = new LabelItem();
+    labelItem()->setFont(font);
+}
+
+MapGraphicsView *LabelLayer::parentView(){
+    return qobject_cast<MapGraphicsView*>(parent());
+}
+
+LabelItem *LabelLayer::labelItem(){
+    return static_cast<LabelItem*>(this->item);
+}
+
+void LabelLayer::addLabel(QString text, double lon, double lat, int priority){
+    Point scp = lonlat2scenePoint(LonLatZoom(lon,lat,0));
+    QFontMetricsF metrics(font);
+    QSizeF size = metrics.size(Qt::TextSingleLine,text) + QSizeF(4,0);
+    labels.push_back({text,QPointF(scp.x,scp.y),size,priority});
+    invalidate();
+}
+
+void LabelLayer::clear(){
+    labels.clear();
+    invalidate();
+}
+
+void LabelLayer::setFont(QFont font){
+    this->font = font;
+    QFontMetricsF metrics(font);
+    for(MapLabel &label: labels){
+        label.size = metrics.size(Qt::TextSingleLine,label.text) + QSizeF(4,0);
+    }
+    labelItem()->setFont(font);
+    invalidate();
+}
+
+QFont LabelLayer::getFont(){
+    return font;
+}
+
+int LabelLayer::getPlacedCount(){
+    return placedCount;
+}
+
+void LabelLayer::invalidate(){
+    dirty = true;
+    if(placementScheduled) return;
+    placementScheduled = true; // batch of additions is placed once
+    QTimer::singleShot(0,this,&LabelLayer::placeLabels);
+}
+
+void LabelLayer::onViewLonLatChanged(double lon, double lat){
+    placeLabels();
+}
+
+void LabelLayer::onViewZoomChanged(double zoom){
+    placeLabels();
+}
+
+void LabelLayer::onViewSizeChanged(int width, int height){
+    placeLabels();
+}
+
+void LabelLayer::placeLabels(){
+    placementScheduled = false;
+    MapGraphicsView *view = parentView();
+    if(!view) return;
+
+    const double zoom = view->getCamera().zoom;
+    const QRectF visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+    const bool reusable = !dirty && zoom == placedZoom && placedRegion.contains(visible); // camera only translated
+    if(reusable && resumeIndex < 0) return;
+
+    if(!reusable){ // start over
+        if(dirty){
+            std::stable_sort(labels.begin(),labels.end(),[](const MapLabel &a, const MapLabel &b){
+                return a.priority > b.priority;
+            });
+        }
+        placedRegion = visible.adjusted(-visible.width()/2,-visible.height()/2,visible.width()/2,visible.height()/2);
+        placedZoom = zoom;
+        placingIndex = LabelGridIndex(placedRegion);
+        placing.clear();
+        resumeIndex = 0;
+        dirty = false;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    const double scale = pow(2,zoom);
+    qsizetype i = resumeIndex;
+    for(; i < labels.size(); i++){
+        if(i > resumeIndex && i % LABEL_BUDGET_CHECK == 0 && clock.elapsed() > frameBudget) break;
+
+        const MapLabel &label = labels[i];
+        const QPointF anchor = label.world * scale;
+        if(!placedRegion.contains(anchor)) continue;
+
+        QRectF rect(anchor.x() + LABEL_OFFSET,anchor.y() - label.size.height()/2,label.size.width(),label.size.height());
+        if(placingIndex.insertIfFree(rect)) placing.push_back({label.text,rect});
+    }
+    resumeIndex = i < labels.size() ? i : -1;
+
+    labelItem()->setPlaced(placing,placedRegion);
+    placedCount = placing.size();
+
+    if(resumeIndex >= 0 && !placementScheduled){ // budget spent, lower priorities on the next pass
+        placementScheduled = true;
+        QTimer::singleShot(0,this,&LabelLayer::placeLabels);
+    }
+}
+
+LabelLayer::~LabelLayer(){
+
+}
+
+// ======================
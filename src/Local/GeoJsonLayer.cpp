@@ -0,0 +1,417 @@
+#include "GeoJsonLayer.h"
+
+#include <QFile>
+#include <QPainter>
+#include <QJsonDocument>
+#include <QGraphicsItemGroup>
+#include <QStyleOptionGraphicsItem>
+
+#define POINT_SIZE 4 // px
+#define LINE_WIDTH 1.5 // px
+
+// ======================
+
+// drops vertices closer than tolerance to the previous kept one, line ends are kept
+static void decimateLine(FeatureLine &line, double tolerance){
+    QPolygonF kept;
+    kept.reserve(line.polygon.size());
+    kept << line.polygon.first();
+    for(qsizetype i = 1; i < line.polygon.size(); i++){
+        const QPointF &p = line.polygon[i];
+        if(i < line.polygon.size()-1 && (p - kept.last()).manhattanLength() < tolerance) continue;
+        kept << p;
+    }
+    line.polygon = kept;
+    line.bounds = kept.boundingRect();
+}
+
+static void decimatePoints(QVector<QPointF> &points, double tolerance){
+    QVector<QPointF> kept;
+    for(const QPointF &p: points){
+        if(!kept.isEmpty() && (p - kept.last()).manhattanLength() < tolerance) continue;
+        kept << p;
+    }
+    points = kept;
+}
+
+static double detailTolerance(int zoom){ // one pixel at zoom, in zoom 0 scene units
+    return 1 / pow(2,zoom);
+}
+
+// ======================
+
+GeoJsonReader::GeoJsonReader(QString path, QSemaphore *credits, QAtomicInt *cancelled, QAtomicInt *detailZoom, QObject *parent) : QObject(parent), path(path), credits(credits), cancelled(cancelled), detailZoom(detailZoom){
+
+}
+
+void GeoJsonReader::read(){
+    QFile file(path);
+    if(!file.open(QIODevice::ReadOnly)){
+        emit failed(file.errorString());
+        emit finished(total);
+        return;
+    }
+
+    flushClock.start();
+    QByteArray buffer;
+    while(!cancelled->loadRelaxed() && !file.atEnd()){
+        buffer += file.read(GEOJSON_READ_BLOCK);
+        scan(buffer);
+    }
+    flush();
+
+    emit finished(total);
+}
+
+// Splits the stream into feature objects: every top level object (newline delimited
+// GeoJSON or a single feature), or every element of a top level "features" array.
+void GeoJsonReader::scan(QByteArray &buffer){
+    const char *data = buffer.constData();
+    for(qsizetype i = scanPos; i < buffer.size(); i++){
+        const char c = data[i];
+        if(inString){
+            if(escape) escape = false;
+            else if(c == '\\') escape = true;
+            else if(c == '"'){
+                inString = false;
+                if(depth == 1) lastString = buffer.mid(stringStart,i-stringStart);
+            }
+            continue;
+        }
+
+        switch(c){
+            case '"':
+                inString = true;
+                stringStart = i+1;
+                break;
+            case '{':
+                if(captureStart < 0 && !skipping && (depth == 0 || depth == featuresDepth)){
+                    captureStart = i;
+                    captureDepth = depth;
+                }
+                depth++;
+                break;
+            case '[':
+                if(depth == 1 && lastString == "features"){ // feature collection, drop the outer capture
+                    captureStart = -1;
+                    featuresDepth = depth+1;
+                }
+                depth++;
+                break;
+            case ']':
+                depth--;
+                if(depth+1 == featuresDepth) featuresDepth = -1;
+                break;
+            case '}':
+                depth--;
+                if(skipping && depth == captureDepth){
+                    skipping = false;
+                } else if(captureStart >= 0 && depth == captureDepth){
+                    parseFeature(buffer.mid(captureStart,i-captureStart+1));
+                    captureStart = -1;
+                }
+                break;
+        }
+    }
+
+    if(captureStart >= 0 && buffer.size() - captureStart > GEOJSON_MAX_FEATURE_BYTES){
+        qWarning() << "GeoJsonReader [path" << path << "] skipping a feature over" << GEOJSON_MAX_FEATURE_BYTES << "bytes";
+        captureStart = -1;
+        skipping = true; // scanned on to its end without buffering
+    }
+
+    // keep only the unfinished feature (and a depth 1 string that may be a key)
+    qsizetype keep = captureStart >= 0 ? captureStart : buffer.size();
+    if(inString && depth == 1) keep = qMin(keep,stringStart);
+    buffer.remove(0,keep);
+    if(captureStart >= 0) captureStart -= keep;
+    if(inString) stringStart -= keep;
+    scanPos = buffer.size();
+}
+
+void GeoJsonReader::parseFeature(const QByteArray &json){
+    QJsonParseError error;
+    QJsonObject object = QJsonDocument::fromJson(json,&error).object();
+    if(error.error != QJsonParseError::NoError){
+        qWarning() << "GeoJsonReader [path" << path << "]" << error.errorString();
+        return;
+    }
+
+    if(object.value("type").toString() == "Feature"){
+        appendGeometry(object.value("geometry").toObject());
+    } else {
+        appendGeometry(object); // bare geometry
+    }
+    features++;
+    total++;
+
+    if(features >= GEOJSON_CHUNK_FEATURES || flushClock.elapsed() >= GEOJSON_FLUSH_INTERVAL){
+        flush();
+    }
+}
+
+void GeoJsonReader::appendGeometry(const QJsonObject &geometry){
+    const QString type = geometry.value("type").toString();
+    const QJsonArray coordinates = geometry.value("coordinates").toArray();
+
+    if(type == "Point"){
+        appendCoordinates(QJsonArray{coordinates},false,true);
+    } else if(type == "MultiPoint"){
+        appendCoordinates(coordinates,false,true);
+    } else if(type == "LineString"){
+        appendCoordinates(coordinates,false,false);
+    } else if(type == "MultiLineString" || type == "Polygon"){
+        for(const QJsonValue &line: coordinates){
+            appendCoordinates(line.toArray(),type == "Polygon",false);
+        }
+    } else if(type == "MultiPolygon"){
+        for(const QJsonValue &polygon: coordinates){
+            for(const QJsonValue &ring: polygon.toArray()){
+                appendCoordinates(ring.toArray(),true,false);
+            }
+        }
+    } else if(type == "GeometryCollection"){
+        for(const QJsonValue &child: geometry.value("geometries").toArray()){
+            appendGeometry(child.toObject());
+        }
+    }
+}
+
+void GeoJsonReader::appendCoordinates(const QJsonArray &coordinates, bool closed, bool points){
+    Part part{(int)lonlats.size(),0,closed,points};
+    for(const QJsonValue &value: coordinates){
+        const QJsonArray position = value.toArray();
+        if(position.size() < 2) continue;
+        lonlats << QPointF(position[0].toDouble(),position[1].toDouble());
+    }
+    part.count = lonlats.size() - part.start;
+    if(part.count) parts << part;
+}
+
+void GeoJsonReader::flush(){
+    flushClock.restart();
+    if(!features) return;
+
+    // project the whole chunk in one pass
+    QVector<QPointF> projected(lonlats.size());
+    for(qsizetype i = 0; i < lonlats.size(); i++){
+        const double lat = qBound(-MAX_MERCATOR_LAT,lonlats[i].y(),MAX_MERCATOR_LAT);
+        Point scp = lonlat2scenePoint(LonLatZoom(lonlats[i].x(),lat,0));
+        projected[i] = QPointF(scp.x,scp.y);
+    }
+
+    // detail finer than a pixel at the layer's detail zoom is never shown, don't keep it
+    const double tolerance = detailTolerance(detailZoom->loadRelaxed());
+    FeatureChunk chunk;
+    chunk.features = features;
+    for(const Part &part: parts){
+        if(part.points){
+            chunk.points += projected.mid(part.start,part.count);
+            continue;
+        }
+        FeatureLine line;
+        line.polygon = QPolygonF(projected.mid(part.start,part.count));
+        if(part.closed && line.polygon.last() != line.polygon.first()) line.polygon << line.polygon.first();
+        decimateLine(line,tolerance);
+        chunk.vertices += line.polygon.size();
+        chunk.lines << line;
+    }
+    decimatePoints(chunk.points,tolerance);
+    chunk.vertices += chunk.points.size();
+
+    lonlats.clear();
+    parts.clear();
+    features = 0;
+
+    // backpressure, GUI thread hands a credit back for every chunk it took
+    while(!credits->tryAcquire(1,100)){
+        if(cancelled->loadRelaxed()) return;
+    }
+    emit chunkReady(chunk);
+}
+
+GeoJsonReader::~GeoJsonReader(){
+
+}
+
+// ======================
+
+FeatureChunkItem::FeatureChunkItem(const FeatureChunk &chunk, QColor color, QGraphicsItem *parent) : QGraphicsItem(parent), lines(chunk.lines), points(chunk.points), color(color){
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption); // exposedRect, panning only repaints strips
+    if(lines.isEmpty() && points.isEmpty()) return;
+
+    // QRectF::united skips empty rects, so a lone point or straight line would be lost
+    QPointF topLeft = lines.isEmpty() ? points.first() : lines.first().bounds.topLeft();
+    QPointF bottomRight = topLeft;
+    for(const FeatureLine &line: lines){
+        topLeft = QPointF(qMin(topLeft.x(),line.bounds.left()),qMin(topLeft.y(),line.bounds.top()));
+        bottomRight = QPointF(qMax(bottomRight.x(),line.bounds.right()),qMax(bottomRight.y(),line.bounds.bottom()));
+    }
+    for(const QPointF &p: points){
+        topLeft = QPointF(qMin(topLeft.x(),p.x()),qMin(topLeft.y(),p.y()));
+        bottomRight = QPointF(qMax(bottomRight.x(),p.x()),qMax(bottomRight.y(),p.y()));
+    }
+    bounds = QRectF(topLeft,bottomRight);
+}
+
+QRectF FeatureChunkItem::boundingRect() const{
+    const qreal margin = POINT_SIZE * pixelSize;
+    return bounds.adjusted(-margin,-margin,margin,margin);
+}
+
+void FeatureChunkItem::setPixelSize(qreal size){
+    prepareGeometryChange();
+    pixelSize = size;
+}
+
+qint64 FeatureChunkItem::decimate(double tolerance){
+    qint64 vertices = 0;
+    for(FeatureLine &line: lines){
+        decimateLine(line,tolerance);
+        vertices += line.polygon.size();
+    }
+    decimatePoints(points,tolerance);
+    update();
+    return vertices + points.size();
+}
+
+void FeatureChunkItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget){
+    QPen pen(color,LINE_WIDTH);
+    pen.setCosmetic(true);
+    painter->setPen(pen);
+    painter->setBrush(Qt::NoBrush);
+
+    const qreal margin = POINT_SIZE * pixelSize;
+    const QRectF exposed = option->exposedRect.adjusted(-margin,-margin,margin,margin);
+
+    QPolygonF decimated;
+    for(const FeatureLine &line: lines){
+        if(!line.bounds.adjusted(-pixelSize,-pixelSize,pixelSize,pixelSize).intersects(exposed)) continue;
+        if(line.bounds.width() < pixelSize && line.bounds.height() < pixelSize){ // under a pixel at this zoom
+            painter->drawPoint(line.bounds.center());
+            continue;
+        }
+
+        // vertices closer than a screen pixel to the previous one are dropped
+        decimated.clear();
+        decimated << line.polygon.first();
+        for(qsizetype i = 1; i < line.polygon.size(); i++){
+            const QPointF &p = line.polygon[i];
+            if(i < line.polygon.size()-1 && (p - decimated.last()).manhattanLength() < pixelSize) continue;
+            decimated << p;
+        }
+        painter->drawPolyline(decimated);
+    }
+
+    if(points.isEmpty()) return;
+    pen.setWidthF(POINT_SIZE);
+    pen.setCapStyle(Qt::RoundCap);
+    painter->setPen(pen);
+    QVector<QPointF> visible;
+    for(const QPointF &p: points){
+        if(exposed.contains(p)) visible << p;
+    }
+    painter->drawPoints(visible.constData(),visible.size());
+}
+
+// ======================
+
+GeoJsonLayer::GeoJsonLayer(QString path, QColor color, QObject *parent) : Layer(0,0,0,parent), path(path), color(color), credits(GEOJSON_MAX_PENDING_CHUNKS){
+    qRegisterMetaType<FeatureChunk>();
+    this->item = new QGraphicsItemGroup();
+}
+
+void GeoJsonLayer::load(){
+    if(thread) return;
+
+    cancelled.storeRelaxed(0);
+    thread = new QThread(this);
+    truncated = false;
+    currentDetailZoom.storeRelaxed(detailZoom);
+    GeoJsonReader *reader = new GeoJsonReader(path,&credits,&cancelled,&currentDetailZoom);
+    reader->moveToThread(thread);
+
+    connect(thread,&QThread::started,reader,&GeoJsonReader::read);
+    connect(reader,&GeoJsonReader::chunkReady,this,&GeoJsonLayer::onChunkReady);
+    connect(reader,&GeoJsonReader::failed,this,[this](QString error){
+        qWarning() << "GeoJsonLayer [path" << path << "]" << error;
+    });
+    connect(reader,&GeoJsonReader::finished,this,&GeoJsonLayer::onReaderFinished);
+    connect(reader,&GeoJsonReader::finished,thread,&QThread::quit);
+    connect(thread,&QThread::finished,reader,&QObject::deleteLater);
+
+    thread->start();
+}
+
+void GeoJsonLayer::cancel(){
+    if(!thread) return;
+    cancelled.storeRelaxed(1);
+    thread->quit();
+    thread->wait();
+}
+
+qint64 GeoJsonLayer::getFeatureCount(){
+    return featureCount;
+}
+
+int GeoJsonLayer::getDetailZoom(){
+    return currentDetailZoom.loadRelaxed();
+}
+
+void GeoJsonLayer::onChunkReady(FeatureChunk chunk){
+    credits.release();
+    if(truncated) return; // already queued when loading stopped
+
+    FeatureChunkItem *chunkItem = new FeatureChunkItem(chunk,color,this->item);
+    qint64 vertices = chunk.vertices;
+    if(chunk.vertices && currentDetailZoom.loadRelaxed() != detailZoom){ // may have been read at a finer detail
+        vertices = chunkItem->decimate(detailTolerance(currentDetailZoom.loadRelaxed()));
+    }
+
+    // over the bound, coarsen everything loaded rather than dropping the rest of the file
+    int zoom = currentDetailZoom.loadRelaxed();
+    while(vertexCount + vertices > maxVertices && zoom > GEOJSON_MIN_DETAIL_ZOOM){
+        zoom = qMax(GEOJSON_MIN_DETAIL_ZOOM,zoom-2);
+        const double tolerance = detailTolerance(zoom);
+        vertexCount = 0;
+        for(FeatureChunkItem *loaded: chunks){
+            vertexCount += loaded->decimate(tolerance);
+        }
+        vertices = chunkItem->decimate(tolerance);
+    }
+    if(zoom != currentDetailZoom.loadRelaxed()){
+        currentDetailZoom.storeRelaxed(zoom); // the reader decimates new chunks as much
+        qWarning() << "GeoJsonLayer [path" << path << "] detail reduced to zoom" << zoom << "to stay under" << maxVertices << "vertices";
+    }
+
+    if(vertexCount + vertices > maxVertices){ // even the coarsest detail doesn't fit
+        delete chunkItem;
+        truncated = true;
+        cancelled.storeRelaxed(1);
+        qWarning() << "GeoJsonLayer [path" << path << "] stopped loading at" << featureCount << "features, over" << maxVertices << "vertices";
+        return;
+    }
+    vertexCount += vertices;
+
+    chunkItem->setPixelSize(1 / this->item->scale());
+    chunks << chunkItem;
+    featureCount += chunk.features;
+}
+
+void GeoJsonLayer::onReaderFinished(){
+    emit loadFinished(featureCount,truncated);
+}
+
+void GeoJsonLayer::onViewZoomChanged(double zoom){
+    const qreal scale = pow(2,zoom);
+    this->item->setScale(scale);
+    for(FeatureChunkItem *chunkItem: chunks){
+        chunkItem->setPixelSize(1 / scale);
+    }
+}
+
+GeoJsonLayer::~GeoJsonLayer(){
+    cancel();
+}
+
+// ======================
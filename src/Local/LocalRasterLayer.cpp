@@ -0,0 +1,314 @@
+#include "LocalRasterLayer.h"
+
+#include <QtConcurrent>
+#include <QStandardPaths>
+#include <QFileInfo>
+#include <QDir>
+#include <QCryptographicHash>
+#include <numeric>
+
+// ======================
+
+// 2x2 box filter of one output row: vertical sums over the contiguous source rows first,
+// then the horizontal pairs
+template<int CH>
+static void boxFilterRow(const uchar *r0, const uchar *r1, int srcWidth, uchar *out, int width, int *sums){
+    const int n = srcWidth * CH;
+    for(int i = 0; i < n; i++){
+        sums[i] = r0[i] + r1[i];
+    }
+    for(int x = 0; x < width; x++){
+        const int *a = sums + 2*x*CH;
+        const int *b = sums + qMin(2*x+1,srcWidth-1)*CH;
+        for(int c = 0; c < CH; c++){
+            out[x*CH+c] = (a[c] + b[c] + 2) >> 2;
+        }
+    }
+}
+
+// horizontal bilinear pass of one source row into 4 channel 8.8 fixed point samples,
+// columns outside of the raster (cx0 < 0) stay transparent
+template<int CH>
+static void resampleRow(const uchar *row, const int *cx0, const int *cx1, const int *cfx, int count, int *out){
+    for(int c = 0; c < count; c++){
+        int *o = out + c*4;
+        if(cx0[c] < 0){
+            o[0] = o[1] = o[2] = o[3] = 0;
+            continue;
+        }
+        const uchar *a = row + cx0[c], *b = row + cx1[c];
+        const int fx = cfx[c];
+        for(int k = 0; k < CH; k++){
+            o[k] = a[k] * (256-fx) + b[k] * fx;
+        }
+        if(CH == 3) o[3] = 255 << 8;
+    }
+}
+
+// ======================
+
+RasterSource::RasterSource(QString path, RasterInfo info, QString cacheDir) : path(path), cacheDir(cacheDir), info(info){
+    if(this->cacheDir.isEmpty()){
+        this->cacheDir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/rasters";
+    }
+    pool.setMaxThreadCount(QThread::idealThreadCount());
+
+    Level base;
+    base.built = true;
+    const qint64 bytes = (qint64)info.width * info.height * info.channels;
+    if(info.channels != 3 && info.channels != 4){
+        qWarning() << "RasterSource [path" << path << "] unsupported channel count" << info.channels;
+    } else {
+        base.file = new QFile(path);
+        if(base.file->open(QIODevice::ReadOnly) && base.file->size() >= info.offset + bytes){
+            base.data = base.file->map(info.offset,bytes);
+        }
+        if(base.data){
+            base.width = info.width;
+            base.height = info.height;
+        } else {
+            qWarning() << "RasterSource [path" << path << "] can't map raster data";
+        }
+    }
+    levels << base;
+
+    // overview sizes down to a single tile, data is generated on first use
+    Level overview;
+    overview.width = base.width;
+    overview.height = base.height;
+    while(overview.width > TILE_SIZE || overview.height > TILE_SIZE){
+        overview.width = (overview.width + 1) / 2;
+        overview.height = (overview.height + 1) / 2;
+        levels << overview;
+    }
+
+    for(int i = 0; i < levels.size(); i++){
+        locks << new QMutex();
+    }
+}
+
+bool RasterSource::isValid(){
+    return levels[0].data != nullptr;
+}
+
+RasterInfo RasterSource::getInfo(){
+    return info;
+}
+
+int RasterSource::levelCount(){
+    return levels.size();
+}
+
+const RasterSource::Level &RasterSource::level(int i){
+    QMutexLocker locker(locks[i]); // building level i only locks i-1, i-2, ... so no cycles
+    Level &lv = levels[i];
+    if(!lv.built){
+        lv.built = true;
+        buildOverview(i);
+    }
+    return lv;
+}
+
+QString RasterSource::overviewPath(int i){
+    // keyed on everything that defines the pixel layout, two rasters with the same
+    // file name in different directories don't share overviews
+    QFileInfo sourceInfo(path);
+    const QString key = QString("%1|%2x%3x%4|%5")
+        .arg(sourceInfo.absoluteFilePath())
+        .arg(info.width).arg(info.height).arg(info.channels)
+        .arg(info.offset);
+    const QString hash = QCryptographicHash::hash(key.toUtf8(),QCryptographicHash::Sha1).toHex().left(16);
+    return QString("%1/%2.%3.%4.ovr").arg(cacheDir,sourceInfo.fileName(),hash).arg(i);
+}
+
+bool RasterSource::buildOverview(int i){
+    const Level &src = level(i-1);
+    if(!src.data) return false;
+
+    Level &dst = levels[i];
+    const qint64 bytes = (qint64)dst.width * dst.height * info.channels;
+    const QString name = overviewPath(i);
+
+    // overview generated by a previous run, only complete ones are ever renamed to name
+    QFileInfo cachedInfo(name);
+    const bool cached = cachedInfo.exists() && cachedInfo.size() == bytes && cachedInfo.lastModified() >= QFileInfo(path).lastModified();
+    if(!cached && !writeOverview(src,dst,name)) return false;
+
+    QFile *file = new QFile(name);
+    if(file->open(QIODevice::ReadOnly)) dst.data = file->map(0,bytes);
+    if(!dst.data){
+        qWarning() << "RasterSource [path" << name << "] can't map overview";
+        delete file;
+        return false;
+    }
+    dst.file = file;
+    return true;
+}
+
+bool RasterSource::writeOverview(const Level &src, const Level &dst, QString name){
+    const int ch = info.channels;
+    const qint64 bytes = (qint64)dst.width * dst.height * ch;
+
+    // filled under a temporary name, a crash mid-build leaves nothing that looks complete
+    QDir().mkpath(cacheDir);
+    QFile part(name + ".part");
+    uchar *out = nullptr;
+    if(part.open(QIODevice::ReadWrite | QIODevice::Truncate) && part.resize(bytes)){
+        out = part.map(0,bytes);
+    }
+    if(!out){
+        qWarning() << "RasterSource [path" << part.fileName() << "] can't write overview";
+        part.remove();
+        return false;
+    }
+
+    // blocks of rows are independent
+    const int blockRows = 64;
+    QVector<int> blocks((dst.height + blockRows - 1) / blockRows);
+    std::iota(blocks.begin(),blocks.end(),0);
+    QtConcurrent::blockingMap(&pool,blocks,[&src,&dst,out,ch,blockRows](int block){
+        QVector<int> sums(src.width * ch);
+        const int last = qMin((block+1) * blockRows,dst.height);
+        for(int y = block * blockRows; y < last; y++){
+            const uchar *r0 = src.data + (qint64)qMin(2*y,src.height-1) * src.width * ch;
+            const uchar *r1 = src.data + (qint64)qMin(2*y+1,src.height-1) * src.width * ch;
+            uchar *o = out + (qint64)y * dst.width * ch;
+            if(ch == 4) boxFilterRow<4>(r0,r1,src.width,o,dst.width,sums.data());
+            else boxFilterRow<3>(r0,r1,src.width,o,dst.width,sums.data());
+        }
+    });
+
+    part.unmap(out);
+    part.close();
+    QFile::remove(name);
+    if(!part.rename(name)){
+        qWarning() << "RasterSource [path" << name << "] can't store overview";
+        part.remove();
+        return false;
+    }
+    return true;
+}
+
+QImage RasterSource::renderTile(int x, int y, int z, int tileSize){
+    if(!isValid()) return QImage();
+
+    const double tileMeters = DIAMETER / pow(2,z);
+    const double left = -DIAMETER/2 + x * tileMeters;
+    const double top = DIAMETER/2 - y * tileMeters;
+    if(left >= info.xmax || left + tileMeters <= info.xmin) return QImage();
+    if(top <= info.ymin || top - tileMeters >= info.ymax) return QImage();
+
+    // coarsest level that still has at least one source pixel per tile pixel
+    const double pixelMeters = tileMeters / tileSize;
+    const double sourceMeters = (info.xmax - info.xmin) / info.width;
+    int li = qBound(0,(int)floor(log2(pixelMeters / sourceMeters)),levelCount()-1);
+    const Level *lv = &level(li);
+    while(!lv->data && li > 0) lv = &level(--li);
+
+    const int ch = info.channels;
+    const double sx = (info.xmax - info.xmin) / lv->width;
+    const double sy = (info.ymax - info.ymin) / lv->height;
+
+    // separable bilinear sample tables, 8 bit fixed point weights
+    QVector<int> cx0(tileSize), cx1(tileSize), cfx(tileSize);
+    for(int c = 0; c < tileSize; c++){
+        double u = (left + (c+0.5) * pixelMeters - info.xmin) / sx - 0.5;
+        if(u < -0.5 || u > lv->width - 0.5){
+            cx0[c] = -1;
+            continue;
+        }
+        u = qBound(0.0,u,lv->width - 1.0);
+        const int i = u;
+        cx0[c] = i * ch;
+        cx1[c] = qMin(i+1,lv->width-1) * ch;
+        cfx[c] = (u - i) * 256;
+    }
+
+    QImage image(tileSize,tileSize,QImage::Format_RGBA8888);
+    image.fill(Qt::transparent);
+
+    // horizontally resampled source rows j and j+1, reused while j doesn't change
+    const int n = tileSize * 4;
+    QVector<int> h0(n), h1(n);
+    int resampled = -1;
+
+    for(int r = 0; r < tileSize; r++){
+        double v = (info.ymax - (top - (r+0.5) * pixelMeters)) / sy - 0.5;
+        if(v < -0.5 || v > lv->height - 0.5) continue;
+        v = qBound(0.0,v,lv->height - 1.0);
+        const int j = v;
+        const int fy = (v - j) * 256;
+
+        if(j != resampled){
+            const uchar *row0 = lv->data + (qint64)j * lv->width * ch;
+            const uchar *row1 = lv->data + (qint64)qMin(j+1,lv->height-1) * lv->width * ch;
+            if(ch == 4){
+                resampleRow<4>(row0,cx0.constData(),cx1.constData(),cfx.constData(),tileSize,h0.data());
+                resampleRow<4>(row1,cx0.constData(),cx1.constData(),cfx.constData(),tileSize,h1.data());
+            } else {
+                resampleRow<3>(row0,cx0.constData(),cx1.constData(),cfx.constData(),tileSize,h0.data());
+                resampleRow<3>(row1,cx0.constData(),cx1.constData(),cfx.constData(),tileSize,h1.data());
+            }
+            resampled = j;
+        }
+
+        // vertical blend over contiguous buffers
+        const int *a = h0.constData(), *b = h1.constData();
+        uchar *o = image.scanLine(r);
+        for(int i = 0; i < n; i++){
+            o[i] = (a[i] * (256-fy) + b[i] * fy + 32768) >> 16;
+        }
+    }
+
+    return image;
+}
+
+RasterSource::~RasterSource(){
+    pool.waitForDone();
+    for(Level &lv: levels){
+        delete lv.file; // unmaps
+    }
+    qDeleteAll(locks);
+}
+
+// ======================
+
+RasterTile::RasterTile(QSharedPointer<RasterSource> source, const TileInfo &info, int zValue, QObject *parent) : Tile(info.px,info.py,zValue,parent){
+    connect(&rendering,&QFutureWatcher<QImage>::finished,this,&RasterTile::onRendered);
+
+    const int x = info.x, y = info.y, z = info.zoom;
+    rendering.setFuture(QtConcurrent::run([source,x,y,z](){
+        return source->renderTile(x,y,z);
+    }));
+}
+
+void RasterTile::onRendered(){
+    if(rendering.isCanceled()) return;
+    QImage image = rendering.result();
+    if(image.isNull()) return; // outside of the raster
+    setPixmap(QPixmap::fromImage(image));
+}
+
+RasterTile::~RasterTile(){
+    rendering.cancel(); // drops it if still queued
+}
+
+// ======================
+
+LocalRasterLayer::LocalRasterLayer(QString path, RasterInfo info, MapGraphicsView *parent) : TileLayer(QString(),{},parent){
+    source = QSharedPointer<RasterSource>::create(path,info);
+}
+
+QSharedPointer<RasterSource> LocalRasterLayer::getSource(){
+    return source;
+}
+
+Tile *LocalRasterLayer::createTile(const TileInfo &info){
+    return new RasterTile(source,info,this->zValue);
+}
+
+LocalRasterLayer::~LocalRasterLayer(){
+
+}
+
+// ======================
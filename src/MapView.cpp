@@ -3,9 +3,22 @@
 #include <QResizeEvent>
 #include <QMouseEvent>
 #include <QLayout>
+#include <QScrollBar>
+#include <QCoreApplication>
+#include <QSettings>
+#include <QStandardPaths>
+#include <QDir>
 
 #include "MapViewCore.h"
 
+#define KINETIC_INTERVAL 16 // ms, ~display refresh rate
+#define KINETIC_DECAY 0.92 // velocity multiplier per tick
+#define KINETIC_MIN_SPEED 0.02 // px/ms, below that kinetic panning stops
+#define KINETIC_RELEASE_DELAY 50 // ms, pointer resting longer than that before release cancels the fling
+
+#define STATE_GROUP "mapview/%1"
+#define SNAPSHOT_FILE "viewport-%1.png"
+
 // =============================
 
 Point mercatorProject(LonLat pos){ // 4326 to 3857
@@ -81,8 +94,20 @@ LonLatZoom scenePoint2lonLat(Point scenePoint, int zoom, int tileSize){
 MapGraphicsView::MapGraphicsView(QWidget *parent) : QGraphicsView(new QGraphicsScene(),parent){
     // scale(1,-1); // flip y axis (will flip all tiles)
 
+    // Panning is done through the (hidden) scroll bars: QGraphicsView then scrolls
+    // the already rendered viewport pixels and repaints only the exposed strips.
+    setHorizontalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setVerticalScrollBarPolicy(Qt::ScrollBarAlwaysOff);
+    setViewportUpdateMode(QGraphicsView::MinimalViewportUpdate);
+    setOptimizationFlags(QGraphicsView::DontSavePainterState | QGraphicsView::DontAdjustForAntialiasing);
+    setResizeAnchor(QGraphicsView::AnchorViewCenter);
+
+    kineticTimer.setInterval(KINETIC_INTERVAL);
+    connect(&kineticTimer,&QTimer::timeout,this,&MapGraphicsView::onKineticTick);
+
     auto camscp = lonlat2scenePoint(cam);
-    scene()->setSceneRect(camscp.x,camscp.y,1,1);
+    updateSceneRect();
+    centerOn(camscp.x,camscp.y);
 
     #ifdef MAPVIEW_DEBUG 
         // scene center
@@ -99,12 +124,13 @@ MapGraphicsView::MapGraphicsView(QWidget *parent) : QGraphicsView(new QGraphicsS
 }
 
 void MapGraphicsView::setCamera(Camera cam){
+    cam.zoom = qBound(minZoom,cam.zoom,maxZoom); // keeps the scroll range within int
     auto previousCam = this->cam;
     this->cam = cam;
     if(previousCam.zoom != cam.zoom){
         onZoomChanged();
     }
-    if(previousCam.lon != cam.lon && previousCam.lat != cam.lat){
+    if(previousCam.lon != cam.lon || previousCam.lat != cam.lat){
         onLonLatChanged();
     }
 }
@@ -121,36 +147,102 @@ Camera MapGraphicsView::getCamera(){
 void MapGraphicsView::resizeEvent(QResizeEvent *event){
     QGraphicsView::resizeEvent(event);
 
+    auto camscp = lonlat2scenePoint(cam);
+    updateSceneRect();
+    centerOn(camscp.x,camscp.y);
+
     emit sizeChanged(width(),height());
 }
 
 void MapGraphicsView::mousePressEvent(QMouseEvent *event){
-    previousP = event->scenePosition();
+    kineticTimer.stop();
+    velocity = QPointF();
+    previousP = event->position().toPoint();
+    dragClock.start();
 }
 
 void MapGraphicsView::mouseMoveEvent(QMouseEvent *event){
-    auto scenePos = event->scenePosition();
+    auto pos = event->position().toPoint();
+
+    QPoint delta = previousP - pos;
+    qint64 elapsed = dragClock.restart();
+    if(elapsed > 0){ // smoothed drag speed, used for the fling on release
+        velocity = velocity * 0.2 + QPointF(delta) / elapsed * 0.8;
+    }
+    panBy(delta);
 
-    QPointF delta = previousP - scenePos;
-    QRectF oldSceneRect = scene()->sceneRect();
-    cam = scenePoint2lonLat(Point(oldSceneRect.x()+delta.x(),oldSceneRect.y()+delta.y()),cam.zoom);
-    onLonLatChanged();
+    previousP = pos;
 
-    previousP = scenePos;
+    QGraphicsView::mouseMoveEvent(event);
+}
 
-    QGraphicsView::mousePressEvent(event);
+void MapGraphicsView::mouseReleaseEvent(QMouseEvent *event){
+    if(dragClock.isValid() && dragClock.elapsed() > KINETIC_RELEASE_DELAY){
+        velocity = QPointF();
+    }
+    if(qAbs(velocity.x()) + qAbs(velocity.y()) >= KINETIC_MIN_SPEED){
+        kineticRemainder = QPointF();
+        kineticTimer.start();
+    }
+
+    QGraphicsView::mouseReleaseEvent(event);
 }
 
 void MapGraphicsView::wheelEvent(QWheelEvent *event){
+    kineticTimer.stop();
     bool wheelUp = event->angleDelta().y() > 0;
-    wheelUp ? cam.zoom += 1 : cam.zoom -=1;
+    const double zoom = qBound(minZoom,cam.zoom + (wheelUp ? 1 : -1),maxZoom);
+    if(zoom == cam.zoom) return; // already at a zoom bound
+    cam.zoom = zoom;
     onZoomChanged();
 }
 
+void MapGraphicsView::paintEvent(QPaintEvent *event){
+    QGraphicsView::paintEvent(event);
+    if(framePainted) return;
+    framePainted = true;
+    QTimer::singleShot(0,this,&MapGraphicsView::firstFramePainted); // after the frame is flushed
+}
+
+void MapGraphicsView::onKineticTick(){
+    QPointF step = velocity * kineticTimer.interval() + kineticRemainder;
+    QPoint pixels = step.toPoint();
+    kineticRemainder = step - pixels;
+    panBy(pixels);
+
+    velocity *= KINETIC_DECAY;
+    if(qAbs(velocity.x()) + qAbs(velocity.y()) < KINETIC_MIN_SPEED){
+        kineticTimer.stop();
+    }
+}
+
+void MapGraphicsView::panBy(QPoint delta){
+    if(delta.isNull()) return;
+
+    horizontalScrollBar()->setValue(horizontalScrollBar()->value() + delta.x());
+    verticalScrollBar()->setValue(verticalScrollBar()->value() + delta.y());
+
+    // same point centerOn() aligns the camera to, QRect::center() is half a pixel off
+    QPointF center = viewportTransform().inverted().map(QPointF(viewport()->width()/2.0,viewport()->height()/2.0));
+    cam = scenePoint2lonLat(Point(center.x(),center.y()),cam.zoom);
+
+    #ifdef MAPVIEW_DEBUG
+        camHLine->setLine(center.x()-256,center.y(),center.x()+256,center.y());
+        camVLine->setLine(center.x(),center.y()-256,center.x(),center.y()+256);
+    #endif
+
+    emit lonLatChanged(cam.lon,cam.lat);
+}
+
+void MapGraphicsView::updateSceneRect(){
+    // whole world at current zoom, padded by the viewport so the camera can reach the edges
+    const double size = pow(2,cam.zoom) * 256;
+    scene()->setSceneRect(-width(),-height(),size+2*width(),size+2*height());
+}
+
 void MapGraphicsView::onLonLatChanged(){
     auto camscp = lonlat2scenePoint(cam);
-    auto previousRect = scene()->sceneRect();
-    scene()->setSceneRect(camscp.x,camscp.y,previousRect.width(),previousRect.height());
+    centerOn(camscp.x,camscp.y);
     qDebug() << "camera: " << cam.lat << cam.lon << "|" << camscp.x << camscp.y;
 
     #ifdef MAPVIEW_DEBUG
@@ -162,12 +254,14 @@ void MapGraphicsView::onLonLatChanged(){
 }
 
 void MapGraphicsView::onZoomChanged(){
+    clearSnapshot(); // drawn at the previous zoom
     auto camscp = lonlat2scenePoint(cam);
     #ifdef MAPVIEW_DEBUG
         camHLine->setLine(camscp.x-256,camscp.y,camscp.x+256,camscp.y);
         camVLine->setLine(camscp.x,camscp.y-256,camscp.x,camscp.y+256);
     #endif
-    scene()->setSceneRect(camscp.x,camscp.y,1,1);
+    updateSceneRect();
+    centerOn(camscp.x,camscp.y);
     emit zoomChanged(cam.zoom);
 }
 
@@ -195,12 +289,88 @@ void MapGraphicsView::addLayer(ILayer *layer){
     connect(this,&MapGraphicsView::sizeChanged,layer,&ILayer::onViewSizeChanged);
 
     layers.push_back(layer);
+
+    layer->onViewZoomChanged(cam.zoom); // render for the current camera right away
 }
 
 void MapGraphicsView::addItem(QGraphicsItem *item){
     scene()->addItem(item);
 }
 
+void MapGraphicsView::setStateKey(QString key){
+    stateKey = key;
+    disconnect(saveOnQuit);
+    if(!key.isEmpty()){
+        saveOnQuit = connect(qApp,&QCoreApplication::aboutToQuit,this,&MapGraphicsView::saveState);
+    }
+}
+
+QString MapGraphicsView::getStateKey(){
+    return stateKey;
+}
+
+QString MapGraphicsView::snapshotPath(){
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/" + QString(SNAPSHOT_FILE).arg(stateKey);
+}
+
+void MapGraphicsView::saveState(){
+    if(stateKey.isEmpty()) return;
+
+    QSettings settings;
+    settings.beginGroup(QString(STATE_GROUP).arg(stateKey));
+    settings.setValue("lon",cam.lon);
+    settings.setValue("lat",cam.lat);
+    settings.setValue("zoom",cam.zoom);
+    settings.setValue("snapshotPos",mapToScene(0,0));
+    settings.endGroup();
+
+    // uncompressed png, decoding speed matters more than size on startup
+    QDir().mkpath(QStandardPaths::writableLocation(QStandardPaths::CacheLocation));
+    #ifdef MAPVIEW_DEBUG
+        camHLine->hide();
+        camVLine->hide();
+    #endif
+    QImage image = viewport()->grab().toImage();
+    #ifdef MAPVIEW_DEBUG
+        camHLine->show();
+        camVLine->show();
+    #endif
+    image.save(snapshotPath(),"PNG",100);
+}
+
+bool MapGraphicsView::restoreState(){
+    if(stateKey.isEmpty()) return false;
+
+    QSettings settings;
+    settings.beginGroup(QString(STATE_GROUP).arg(stateKey));
+    if(!settings.contains("zoom")) return false;
+    Camera saved(
+        settings.value("lon").toDouble(),
+        settings.value("lat").toDouble(),
+        settings.value("zoom").toDouble()
+    );
+    QPointF snapshotPos = settings.value("snapshotPos").toPointF();
+    settings.endGroup();
+
+    setCamera(saved);
+
+    QPixmap pixmap;
+    if(!pixmap.load(snapshotPath())) return true;
+    pixmap.setDevicePixelRatio(devicePixelRatioF());
+
+    clearSnapshot();
+    snapshot = scene()->addPixmap(pixmap);
+    snapshot->setPos(snapshotPos);
+    snapshot->setZValue(-1); // under every layer
+    return true;
+}
+
+void MapGraphicsView::clearSnapshot(){
+    if(!snapshot) return;
+    delete snapshot;
+    snapshot = nullptr;
+}
+
 MapGraphicsView::~MapGraphicsView(){
 
 }
\ No newline at end of file
@@ -30,6 +30,10 @@ LonLat::LonLat(double lon, double lat): Point(lon,lat){
 
 }
 
+LonLat::LonLat(const LonLat & other): Point(other){
+
+}
+
 LonLat &LonLat::operator=(const LonLat & other){
     Point::operator=(other);
     return *this;
@@ -86,6 +90,11 @@ void Layer::setPos(int px, int py, int zValue){
     }
 }
 
+void Layer::setZValue(int zValue){
+    ILayer::setZValue(zValue);
+    if(item) item->setZValue(zValue);
+}
+
 Point3D Layer::getPos(){
     return {(double)px, (double)py, (double)zValue};
 }
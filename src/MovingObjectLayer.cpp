@@ -0,0 +1,217 @@
+#include "MovingObjectLayer.h"
+#include "TMSLayer.h"
+
+#include <QPainter>
+#include <QStyleOptionGraphicsItem>
+
+// ======================
+
+MovingObjectItem::MovingObjectItem(MovingObjectLayer *layer, QGraphicsItem *parent) : QGraphicsItem(parent), layer(layer){
+    setFlag(QGraphicsItem::ItemUsesExtendedStyleOption); // exposedRect
+}
+
+QRectF MovingObjectItem::boundingRect() const{
+    const qreal size = TILE_SIZE * scale; // whole world
+    return QRectF(0,0,size,size).adjusted(-MOVING_SYMBOL_SIZE,-MOVING_SYMBOL_SIZE,MOVING_SYMBOL_SIZE,MOVING_SYMBOL_SIZE);
+}
+
+void MovingObjectItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget){
+    layer->paintObjects(painter,option->exposedRect);
+}
+
+void MovingObjectItem::setZoom(double zoom){
+    prepareGeometryChange();
+    scale = pow(2,zoom);
+}
+
+// ======================
+
+MovingObjectLayer::MovingObjectLayer(QObject *parent) : Layer(0,0,0,parent){
+    this->item = new MovingObjectItem(this);
+
+    frameTimer.setInterval(MOVING_FRAME_INTERVAL);
+    connect(&frameTimer,&QTimer::timeout,this,&MovingObjectLayer::applyUpdates);
+    frameTimer.start();
+}
+
+MapGraphicsView *MovingObjectLayer::parentView(){
+    return qobject_cast<MapGraphicsView*>(parent());
+}
+
+void MovingObjectLayer::pushUpdates(const QVector<ObjectUpdate> &updates){
+    QMutexLocker locker(&pendingMutex);
+    for(const ObjectUpdate &update: updates){
+        auto it = pending.find(update.id);
+        if(it == pending.end() || update.remove){
+            pending.insert(update.id,update);
+            continue;
+        }
+        if(it->remove){ // the object is gone by the time this applies
+            if(!update.hasPosition) continue; // nothing to place
+            ObjectUpdate readded = update; // a new object, its old heading doesn't carry over
+            readded.hasHeading = true;
+            if(!update.hasHeading) readded.heading = qQNaN();
+            *it = readded;
+            continue;
+        }
+        // newer fields win, fields it doesn't carry are kept from the unapplied one
+        if(update.hasPosition){
+            it->lon = update.lon;
+            it->lat = update.lat;
+            it->hasPosition = true;
+        }
+        if(update.hasHeading){
+            it->heading = update.heading;
+            it->hasHeading = true;
+        }
+    }
+}
+
+int MovingObjectLayer::getObjectCount(){
+    return objects.size();
+}
+
+int MovingObjectLayer::cellOf(QPointF world){
+    const int cx = qBound(0,(int)(world.x() / TILE_SIZE * MOVING_INDEX_GRID),MOVING_INDEX_GRID-1);
+    const int cy = qBound(0,(int)(world.y() / TILE_SIZE * MOVING_INDEX_GRID),MOVING_INDEX_GRID-1);
+    return cy * MOVING_INDEX_GRID + cx;
+}
+
+QVector<quint32> MovingObjectLayer::objectsIn(const QRectF &worldRect){
+    QVector<quint32> result;
+    const int first = cellOf(worldRect.topLeft());
+    const int last = cellOf(worldRect.bottomRight());
+    const int x0 = first % MOVING_INDEX_GRID, y0 = first / MOVING_INDEX_GRID;
+    const int x1 = last % MOVING_INDEX_GRID, y1 = last / MOVING_INDEX_GRID;
+
+    if((qint64)(x1-x0+1) * (y1-y0+1) > objects.size()){ // cheaper to scan everything
+        for(auto it = objects.cbegin(); it != objects.cend(); ++it){
+            if(worldRect.contains(it.value().world)) result << it.key();
+        }
+        return result;
+    }
+
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            auto cell = index.constFind(y * MOVING_INDEX_GRID + x);
+            if(cell == index.constEnd()) continue;
+            for(quint32 id: *cell){
+                if(worldRect.contains(objects[id].world)) result << id;
+            }
+        }
+    }
+    return result;
+}
+
+void MovingObjectLayer::markDirty(QPointF world){
+    const QPointF scenePos = world * scale;
+    const QRectF symbol(scenePos.x() - MOVING_SYMBOL_SIZE,scenePos.y() - MOVING_SYMBOL_SIZE,2*MOVING_SYMBOL_SIZE,2*MOVING_SYMBOL_SIZE);
+    if(!visible.intersects(symbol)) return;
+
+    const int x0 = floor(symbol.left() / MOVING_DIRTY_BUCKET), x1 = floor(symbol.right() / MOVING_DIRTY_BUCKET);
+    const int y0 = floor(symbol.top() / MOVING_DIRTY_BUCKET), y1 = floor(symbol.bottom() / MOVING_DIRTY_BUCKET);
+    for(int y = y0; y <= y1; y++){
+        for(int x = x0; x <= x1; x++){
+            dirtyBuckets.insert({x,y});
+        }
+    }
+}
+
+void MovingObjectLayer::applyUpdates(){
+    QHash<quint32,ObjectUpdate> batch;
+    {
+        QMutexLocker locker(&pendingMutex);
+        if(pending.isEmpty()) return;
+        batch.swap(pending);
+    }
+
+    if(MapGraphicsView *view = parentView()){
+        visible = view->mapToScene(view->viewport()->rect()).boundingRect();
+    }
+
+    for(const ObjectUpdate &update: batch){
+        auto it = objects.find(update.id);
+        if(it != objects.end()){
+            markDirty(it->world);
+        }
+
+        if(update.remove){
+            if(it == objects.end()) continue;
+            index[it->cell].removeOne(update.id);
+            objects.erase(it);
+            continue;
+        }
+
+        if(it == objects.end() && !update.hasPosition) continue; // can't be placed yet
+
+        MovingObject object = it != objects.end() ? *it : MovingObject{QPointF(),qQNaN(),-1};
+        if(update.hasPosition){
+            const double lat = qBound(-MAX_MERCATOR_LAT,update.lat,MAX_MERCATOR_LAT);
+            Point scp = lonlat2scenePoint(LonLatZoom(update.lon,lat,0));
+            object.world = QPointF(scp.x,scp.y);
+            object.cell = cellOf(object.world);
+        }
+        if(update.hasHeading){
+            object.heading = update.heading;
+        }
+
+        if(it == objects.end()){
+            objects.insert(update.id,object);
+            index[object.cell].push_back(update.id);
+        } else {
+            if(it->cell != object.cell){ // incremental index update, only on cell change
+                index[it->cell].removeOne(update.id);
+                index[object.cell].push_back(update.id);
+            }
+            *it = object;
+        }
+        markDirty(object.world);
+    }
+
+    for(const QPair<int,int> &bucket: dirtyBuckets){
+        this->item->update(bucket.first * MOVING_DIRTY_BUCKET,bucket.second * MOVING_DIRTY_BUCKET,MOVING_DIRTY_BUCKET,MOVING_DIRTY_BUCKET);
+    }
+    dirtyBuckets.clear();
+}
+
+void MovingObjectLayer::paintObjects(QPainter *painter, const QRectF &exposed){
+    const qreal margin = MOVING_SYMBOL_SIZE;
+    const QRectF worldRect(
+        (exposed.left() - margin) / scale,
+        (exposed.top() - margin) / scale,
+        (exposed.width() + 2*margin) / scale,
+        (exposed.height() + 2*margin) / scale
+    );
+
+    painter->setPen(QPen(Qt::white,1));
+    painter->setBrush(color);
+
+    const qreal r = MOVING_SYMBOL_SIZE / 2.0;
+    for(quint32 id: objectsIn(worldRect)){
+        const MovingObject &object = objects[id];
+        const QPointF p = object.world * scale;
+
+        if(qIsNaN(object.heading)){
+            painter->drawEllipse(p,r/2,r/2);
+            continue;
+        }
+
+        // arrow pointing along the heading, rotated by hand to avoid a transform per object
+        const double a = rad(object.heading);
+        const double s = sin(a), c = cos(a);
+        auto rotated = [&](double x, double y){ return QPointF(p.x() + x*c - y*s, p.y() + x*s + y*c); };
+        const QPointF arrow[3] = {rotated(0,-r),rotated(r*0.6,r),rotated(-r*0.6,r)};
+        painter->drawPolygon(arrow,3);
+    }
+}
+
+void MovingObjectLayer::onViewZoomChanged(double zoom){
+    scale = pow(2,zoom);
+    static_cast<MovingObjectItem*>(this->item)->setZoom(zoom);
+}
+
+MovingObjectLayer::~MovingObjectLayer(){
+
+}
+
+// ======================
@@ -1,40 +1,82 @@
 #include "TMSLayer.h"
 
-QNetworkAccessManager *mgr = new QNetworkAccessManager();
+// ======================
+
+TileGrid getVisibleTiles(MapGraphicsView *view){
+    const int incrementX = TILE_SIZE, incrementY = TILE_SIZE;
+	
+	const int clientWidth = view->width() + incrementX; 
+	const int clientHeight = view->height() + incrementY;
+
+    auto cam = view->getCamera();
+	
+	Point centerpx = lonlat2scenePoint(cam);
+	
+	BBox bbox(
+		floor((centerpx.x - clientWidth / 2) / TILE_SIZE),
+		floor((centerpx.y - clientHeight / 2 ) / TILE_SIZE),
+		ceil((centerpx.x + clientWidth / 2) / TILE_SIZE),
+		ceil((centerpx.y + clientHeight / 2) / TILE_SIZE)
+	);
+ 	
+	QVector<TileInfo> tileInfos;
+	
+	for(int x = bbox.xmin; x < bbox.xmax; ++x){
+		for(int y = bbox.ymin; y < bbox.ymax; ++y){
+            auto scp = lonlat2scenePoint(tile2lonlat({(double)x,(double)y,cam.zoom}));
+			tileInfos.push_back(TileInfo(
+				x,y,cam.zoom,
+                scp.x,scp.y
+			));
+		}
+	}
+	
+	return tileInfos;
+}
 
 // ======================
 
-Tile::Tile(QString url, int px, int py, int zValue, QObject *parent) : Layer(px,py,zValue,parent), url(url){
-    QNetworkRequest req(url);
-    reply = mgr->get(req);
-    reply->setParent(this);
-    connect(reply,&QNetworkReply::finished,this,&Tile::processResponse);
+Tile::Tile(int px, int py, int zValue, QObject *parent) : Layer(px,py,zValue,parent){
+
+}
+
+Tile::Tile(QString url, TileFetcher *fetcher, int px, int py, int zValue, QObject *parent) : Layer(px,py,zValue,parent), url(url){
+    request = fetcher->fetch(url,this);
+    connect(request,&TileRequest::finished,this,&Tile::processResponse);
+    connect(request,&TileRequest::failed,this,&Tile::processFailure);
 };
 
-void Tile::processResponse(){
+void Tile::processResponse(QByteArray data){
     qDebug() << "Tile [url " << url << "]  [pos "<< this->px << "px" << "," << this->py << "py]";
-    bool netError = !reply->error();
-    assert(netError);
-    if(!netError) return;
 
     QPixmap temppix;
-    bool loadError = temppix.loadFromData(reply->readAll());
-    assert(loadError);
-    if(!loadError) return;
+    if(!temppix.loadFromData(data)){
+        qWarning() << "Tile [url " << url << "] invalid image data";
+        return;
+    }
+
+    setPixmap(temppix);
+    request->deleteLater();
+}
 
+void Tile::setPixmap(QPixmap pixmap){
     #ifdef MAPVIEW_DEBUG // tile border
-        QPainter p(&temppix);
+        QPainter p(&pixmap);
         p.setPen(Qt::black);
-        p.drawRect(0,0,temppix.width(),temppix.height());
+        p.drawRect(0,0,pixmap.width(),pixmap.height());
     #endif
 
 
-    this->item = new QGraphicsPixmapItem(temppix);
+    this->item = new QGraphicsPixmapItem(pixmap);
     this->item->setPos(this->px,this->py);
     this->item->setZValue(this->zValue);
 
     emit this->itemCreated(this->item);
-    reply->deleteLater();
+}
+
+void Tile::processFailure(QString error){
+    qWarning() << "Tile [url " << url << "] gave up:" << error;
+    request->deleteLater();
 }
 
 Tile::~Tile(){
@@ -43,14 +85,23 @@ Tile::~Tile(){
 
 // ======================
 
-TileLayer::TileLayer(QString baseUrl, MapGraphicsView *parent) : LayerGroup(zValue,parent), baseUrl(baseUrl){
-
+TileLayer::TileLayer(QString baseUrl, QStringList subdomains, MapGraphicsView *parent) : LayerGroup(zValue,parent), baseUrl(baseUrl){
+    fetcher = new TileFetcher(nullptr,this);
+    fetcher->setSubdomains(subdomains);
 }
 
 MapGraphicsView *TileLayer::parentView(){
     return static_cast<MapGraphicsView*>(parent());
 }
 
+void TileLayer::setFetcher(TileFetcher *fetcher){
+    this->fetcher = fetcher;
+}
+
+TileFetcher *TileLayer::getFetcher(){
+    return fetcher;
+}
+
 bool TileLayer::validateTileUrl(int x, int y, int z){
     if(x < 0 || y < 0 || z < 0) return false;
     if(z > maxZoom) return false;
@@ -59,6 +110,7 @@ bool TileLayer::validateTileUrl(int x, int y, int z){
     return true;
 }
 
+// {s} is left in place, the fetcher picks the mirror per request
 QString TileLayer::getTileUrl(int x, int y, int z){
     QString result = baseUrl;
     result = result.replace("{x}",QString::number(x));
@@ -68,37 +120,7 @@ QString TileLayer::getTileUrl(int x, int y, int z){
 }
 
 QVector<TileInfo> TileLayer::getVisibleTiles(){
-    MapGraphicsView *view = parentView();
-
-    const int incrementX = TILE_SIZE, incrementY = TILE_SIZE;
-	
-	const int clientWidth = view->width() + incrementX; 
-	const int clientHeight = view->height() + incrementY;
-
-    auto cam = view->getCamera();
-	
-	Point centerpx = lonlat2scenePoint(cam);
-	
-	BBox bbox(
-		floor((centerpx.x - clientWidth / 2) / TILE_SIZE),
-		floor((centerpx.y - clientHeight / 2 ) / TILE_SIZE),
-		ceil((centerpx.x + clientWidth / 2) / TILE_SIZE),
-		ceil((centerpx.y + clientHeight / 2) / TILE_SIZE)
-	);
- 	
-	QVector<TileInfo> tileInfos;
-	
-	for(int x = bbox.xmin; x < bbox.xmax; ++x){
-		for(int y = bbox.ymin; y < bbox.ymax; ++y){
-            auto scp = lonlat2scenePoint(tile2lonlat({(double)x,(double)y,cam.zoom}));
-			tileInfos.push_back(TileInfo(
-				x,y,cam.zoom,
-                scp.x,scp.y
-			));
-		}
-	}
-	
-	return tileInfos;
+    return ::getVisibleTiles(parentView());
 }
 
 void TileLayer::onViewLonLatChanged(double lon, double lat){
@@ -138,12 +160,16 @@ void TileLayer::renderTiles(){
 
     for(auto tileInfo: newGrid){
         if(!validateTileUrl(tileInfo.x,tileInfo.y,tileInfo.zoom)) continue;
-        Tile *tile = new Tile(getTileUrl(tileInfo.x,tileInfo.y,tileInfo.zoom),tileInfo.px,tileInfo.py,this->zValue);
+        Tile *tile = createTile(tileInfo);
         tileStack[{tileInfo.px,tileInfo.py}] = tile;
         connect(tile,&Layer::itemCreated,this,&LayerGroup::itemCreated);
     }
 }
 
+Tile *TileLayer::createTile(const TileInfo &info){
+    return new Tile(getTileUrl(info.x,info.y,info.zoom),fetcher,info.px,info.py,this->zValue);
+}
+
 void TileLayer::clearTiles(){
     for(Tile *tile: tileStack){
         tile->deleteLater(); // also delete from scene
@@ -0,0 +1,224 @@
+#include "TileFetcher.h"
+
+#include <QRandomGenerator>
+#include <QDebug>
+#include <algorithm>
+
+// ======================
+
+void HostStats::addLatency(qint64 ms){
+    if(latencies.size() < HOST_STATS_WINDOW){
+        latencies.push_back(ms);
+    } else {
+        latencies[next] = ms;
+        next = (next + 1) % HOST_STATS_WINDOW;
+    }
+}
+
+qint64 HostStats::percentile(double p) const{
+    if(latencies.isEmpty()) return -1;
+    QVector<qint64> sorted = latencies;
+    const int i = qBound(0,(int)(p * (sorted.size()-1) + 0.5),(int)sorted.size()-1);
+    std::nth_element(sorted.begin(),sorted.begin()+i,sorted.end());
+    return sorted[i];
+}
+
+// ======================
+
+TileRequest::TileRequest(QString urlTemplate, TileFetcher *fetcher, QObject *parent) : QObject(parent), urlTemplate(urlTemplate), fetcher(fetcher){
+    hedgeTimer.setSingleShot(true);
+    retryTimer.setSingleShot(true);
+    connect(&hedgeTimer,&QTimer::timeout,this,&TileRequest::hedge);
+    connect(&retryTimer,&QTimer::timeout,this,&TileRequest::retry);
+
+    clock.start();
+    startAttempt();
+}
+
+void TileRequest::startAttempt(){
+    if(!fetcher) return;
+
+    QStringList busy;
+    for(const Attempt &attempt: attempts){
+        busy << attempt.subdomain;
+    }
+    QString subdomain = fetcher->pickSubdomain(busy);
+
+    QNetworkRequest req(fetcher->resolveUrl(urlTemplate,subdomain));
+    QNetworkReply *reply = fetcher->manager()->get(req);
+    reply->setParent(this);
+    attempts[reply] = {subdomain,clock.elapsed()};
+    fetcher->attemptStarted(subdomain);
+    connect(reply,&QNetworkReply::finished,this,&TileRequest::onReplyFinished);
+
+    busy << subdomain;
+    if(hedges < fetcher->maxHedges && fetcher->hasAlternative(busy)){ // a hedge to the same host can't help
+        hedgeTimer.start(fetcher->hedgeDelay(subdomain));
+    }
+}
+
+void TileRequest::hedge(){
+    if(done) return;
+    hedges++;
+    startAttempt();
+}
+
+void TileRequest::retry(){
+    if(done) return;
+    retries++;
+    hedges = 0;
+    startAttempt();
+}
+
+void TileRequest::onReplyFinished(){
+    QNetworkReply *reply = qobject_cast<QNetworkReply*>(sender());
+    if(!reply || !attempts.contains(reply)) return;
+
+    Attempt attempt = attempts.take(reply);
+    reply->deleteLater();
+    const bool ok = reply->error() == QNetworkReply::NoError;
+    if(fetcher) fetcher->attemptFinished(attempt.subdomain,clock.elapsed() - attempt.startedAt,ok);
+
+    if(ok){
+        done = true;
+        hedgeTimer.stop();
+        abortAttempts(true);
+        emit finished(reply->readAll());
+        return;
+    }
+
+    qWarning() << "Tile request failed [url" << reply->url() << "]" << reply->errorString();
+    if(!attempts.isEmpty()) return; // a hedged duplicate is still running
+
+    hedgeTimer.stop();
+    const bool retryable = reply->error() != QNetworkReply::ContentNotFoundError;
+    if(!fetcher || !retryable || retries >= fetcher->maxRetries){
+        done = true;
+        emit failed(reply->errorString());
+        return;
+    }
+
+    const int backoff = fetcher->retryBackoff << retries;
+    retryTimer.start(backoff + QRandomGenerator::global()->bounded(backoff / 2 + 1));
+}
+
+void TileRequest::abortAttempts(bool lost){ // lost - another mirror answered first
+    for(auto it = attempts.begin(); it != attempts.end(); ++it){
+        QNetworkReply *reply = it.key();
+        disconnect(reply,&QNetworkReply::finished,this,&TileRequest::onReplyFinished);
+        if(fetcher) fetcher->attemptCancelled(it.value().subdomain,clock.elapsed() - it.value().startedAt,lost);
+        reply->abort();
+        reply->deleteLater();
+    }
+    attempts.clear();
+}
+
+TileRequest::~TileRequest(){
+    abortAttempts(false);
+}
+
+// ======================
+
+TileFetcher::TileFetcher(QNetworkAccessManager *manager, QObject *parent) : QObject(parent), mgr(manager){
+    if(!mgr) mgr = new QNetworkAccessManager(this);
+}
+
+TileRequest *TileFetcher::fetch(QString urlTemplate, QObject *parent){
+    return new TileRequest(urlTemplate,this,parent);
+}
+
+void TileFetcher::setSubdomains(QStringList subdomains){
+    this->subdomains = subdomains;
+}
+
+QStringList TileFetcher::getSubdomains(){
+    return subdomains;
+}
+
+HostStats TileFetcher::getStats(QString subdomain){
+    return stats.value(subdomain);
+}
+
+QString TileFetcher::pickSubdomain(const QStringList &exclude){
+    if(subdomains.isEmpty()) return QString();
+
+    QStringList candidates;
+    for(const QString &subdomain: subdomains){
+        if(!exclude.contains(subdomain)) candidates << subdomain;
+    }
+    if(candidates.isEmpty()) candidates = subdomains;
+
+    // lowest expected wait wins, untried hosts are tried first, ties are
+    // broken in round robin order so load is spread evenly
+    const int offset = roundRobin++;
+    QString best;
+    double bestScore = 0;
+    for(int i = 0; i < candidates.size(); i++){
+        const QString &subdomain = candidates[(offset + i) % candidates.size()];
+        const HostStats &host = stats[subdomain];
+        const qint64 median = host.percentile(0.5);
+        const bool tried = host.failures || host.aborted;
+        const double expected = median < 0 ? (tried ? defaultHedgeDelay : 0) : median;
+        const double score = (expected + 1) * (1 + host.inFlight) * (1 + host.failures + host.aborted);
+        if(best.isNull() || score < bestScore){
+            best = subdomain;
+            bestScore = score;
+        }
+    }
+    return best;
+}
+
+bool TileFetcher::hasAlternative(const QStringList &exclude){
+    for(const QString &subdomain: subdomains){
+        if(!exclude.contains(subdomain)) return true;
+    }
+    return false;
+}
+
+QString TileFetcher::resolveUrl(QString urlTemplate, QString subdomain){
+    return urlTemplate.replace("{s}",subdomain);
+}
+
+int TileFetcher::hedgeDelay(QString subdomain){
+    const HostStats &host = stats[subdomain];
+    if(host.latencies.size() < minHedgeSamples) return defaultHedgeDelay;
+    return qMax<qint64>(minHedgeDelay,host.percentile(hedgePercentile));
+}
+
+QNetworkAccessManager *TileFetcher::manager(){
+    return mgr;
+}
+
+void TileFetcher::attemptStarted(QString subdomain){
+    stats[subdomain].inFlight++;
+}
+
+void TileFetcher::attemptFinished(QString subdomain, qint64 latency, bool ok){
+    HostStats &host = stats[subdomain];
+    host.inFlight--;
+    if(ok){
+        host.failures = 0;
+        host.aborted = 0;
+        host.addLatency(latency);
+    } else {
+        host.failures++;
+    }
+}
+
+void TileFetcher::attemptCancelled(QString subdomain, qint64 elapsed, bool lost){
+    HostStats &host = stats[subdomain];
+    host.inFlight--;
+    if(!lost) return;
+    host.aborted++; // a host that always loses stops looking untried
+
+    // elapsed is only a lower bound, a hedge aborted right after it started would drag the
+    // percentiles down, so it is only kept when it says the host is slower than thought
+    const qint64 median = host.percentile(0.5);
+    if(median >= 0 && elapsed >= median) host.addLatency(elapsed);
+}
+
+TileFetcher::~TileFetcher(){
+
+}
+
+// ======================
@@ -8,13 +8,21 @@
 int main(int argc, char *argv[]){
     QApplication app(argc,argv);
 
+    app.setOrganizationName("QMapViewSample");
+    app.setApplicationName("QMapViewSample");
+
     MainWindow *mw = new MainWindow();
+    mw->mapView->setStateKey("main");
+    bool restored = mw->mapView->restoreState(); // last viewport snapshot is visible on the first frame
     mw->show();
 
-    mw->mapView->addLayer(new TileLayer("http://t2.openseamap.org/tile/{z}/{x}/{y}.png"));
-    mw->mapView->addLayer(new TileLayer("http://tiles.openseamap.org/seamark/{z}/{x}/{y}.png"));
+    // live layers are built once the first frame is on screen
+    QObject::connect(mw->mapView,&MapGraphicsView::firstFramePainted,mw,[mw,restored](){
+        if(!restored) mw->mapView->setCamera(30.3223,59.9292,12);
 
-    mw->mapView->setCamera(30.3223,59.9292,12);
+        mw->mapView->addLayer(new TileLayer("http://{s}.openseamap.org/tile/{z}/{x}/{y}.png",{"t1","t2"}));
+        mw->mapView->addLayer(new TileLayer("http://tiles.openseamap.org/seamark/{z}/{x}/{y}.png"));
+    });
     
     return app.exec();
 }
\ No newline at end of file
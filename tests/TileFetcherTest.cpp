@@ -0,0 +1,133 @@
+#include "TileFetcher.h"
+
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+
+// ======================
+
+// Minimal HTTP stand-in for a tile mirror, answers every request after `delay` ms.
+// The first `failFirst` requests get a 500, the rest `status`.
+class StandInServer : public QTcpServer{
+    public:
+        StandInServer(int delay, int status=200, int failFirst=0, QObject *parent=nullptr)
+            : QTcpServer(parent), delay(delay), status(status), failFirst(failFirst){
+            listen(QHostAddress::LocalHost);
+            connect(this,&QTcpServer::newConnection,this,&StandInServer::onNewConnection);
+        }
+
+        QString host(){
+            return QString("127.0.0.1:%1").arg(serverPort());
+        }
+
+        int delay;
+        int status;
+        int failFirst;
+        int hits = 0;
+
+    private:
+        void onNewConnection(){
+            while(QTcpSocket *socket = nextPendingConnection()){
+                connect(socket,&QTcpSocket::disconnected,socket,&QObject::deleteLater);
+                connect(socket,&QTcpSocket::readyRead,this,[this,socket](){
+                    if(!socket->property("request").toByteArray().isEmpty()) return;
+                    QByteArray request = socket->property("buffer").toByteArray() + socket->readAll();
+                    socket->setProperty("buffer",request);
+                    if(!request.contains("\r\n\r\n")) return;
+                    socket->setProperty("request",request);
+
+                    const int code = hits++ < failFirst ? 500 : status;
+                    QPointer<QTcpSocket> guard(socket);
+                    QTimer::singleShot(delay,this,[guard,code](){
+                        if(!guard || guard->state() != QAbstractSocket::ConnectedState) return; // aborted by the client
+                        const QByteArray body = code == 200 ? QByteArray("tile") : QByteArray();
+                        guard->write(QString("HTTP/1.1 %1 X\r\nContent-Length: %2\r\nConnection: close\r\n\r\n")
+                            .arg(code).arg(body.size()).toLatin1() + body);
+                        guard->disconnectFromHost();
+                    });
+                });
+            }
+        }
+};
+
+// ======================
+
+class TileFetcherTest : public QObject{
+    Q_OBJECT
+
+    private slots:
+        void hedgesToFasterMirror();
+        void noHedgeWithSingleMirror();
+        void retriesWithBackoff();
+        void notFoundIsNotRetried();
+};
+
+void TileFetcherTest::hedgesToFasterMirror(){
+    StandInServer slow(3000), fast(10);
+    TileFetcher fetcher;
+    fetcher.setSubdomains({slow.host(),fast.host()}); // untried hosts tie, the first one is picked
+    fetcher.defaultHedgeDelay = 100;
+
+    TileRequest *request = fetcher.fetch("http://{s}/tile/1/2/3.png",this);
+    QSignalSpy finished(request,&TileRequest::finished);
+    QVERIFY(finished.wait(2000));
+    QCOMPARE(finished.first().first().toByteArray(),QByteArray("tile"));
+    QCOMPARE(slow.hits,1);
+    QCOMPARE(fast.hits,1);
+
+    // the loser counts as tried and slow, its censored time isn't taken as a sample
+    const HostStats stats = fetcher.getStats(slow.host());
+    QCOMPARE(stats.aborted,1);
+    QCOMPARE(stats.inFlight,0);
+    QCOMPARE(stats.percentile(0.5),qint64(-1));
+    QCOMPARE(fetcher.pickSubdomain(),fast.host());
+    QCOMPARE(fetcher.pickSubdomain(),fast.host());
+    delete request;
+}
+
+void TileFetcherTest::noHedgeWithSingleMirror(){
+    StandInServer server(300);
+    TileFetcher fetcher;
+    fetcher.setSubdomains({server.host()});
+    fetcher.defaultHedgeDelay = 50;
+
+    TileRequest *request = fetcher.fetch("http://{s}/tile/1/2/3.png",this);
+    QSignalSpy finished(request,&TileRequest::finished);
+    QVERIFY(finished.wait(2000));
+    QCOMPARE(server.hits,1);
+    delete request;
+}
+
+void TileFetcherTest::retriesWithBackoff(){
+    StandInServer server(0,200,2);
+    TileFetcher fetcher;
+    fetcher.setSubdomains({server.host()});
+    fetcher.retryBackoff = 50;
+
+    QElapsedTimer clock;
+    clock.start();
+    TileRequest *request = fetcher.fetch("http://{s}/tile/1/2/3.png",this);
+    QSignalSpy finished(request,&TileRequest::finished);
+    QVERIFY(finished.wait(3000));
+    QCOMPARE(server.hits,3);
+    QVERIFY(clock.elapsed() >= 50 + 100); // two backoffs, doubled
+    QCOMPARE(fetcher.getStats(server.host()).failures,0);
+    delete request;
+}
+
+void TileFetcherTest::notFoundIsNotRetried(){
+    StandInServer server(0,404);
+    TileFetcher fetcher;
+    fetcher.setSubdomains({server.host()});
+    fetcher.retryBackoff = 10;
+
+    TileRequest *request = fetcher.fetch("http://{s}/tile/1/2/3.png",this);
+    QSignalSpy failed(request,&TileRequest::failed);
+    QVERIFY(failed.wait(2000));
+    QTest::qWait(100);
+    QCOMPARE(server.hits,1);
+    delete request;
+}
+
+QTEST_MAIN(TileFetcherTest)
+#include "TileFetcherTest.moc"